@@ -0,0 +1,94 @@
+//compare the single key wrapper from runsh9.js against the batched
+// TextEncoder.encodeInto ring in sh9batch.js, bulk loading through it and
+// the Buffer stream in sh9stream.js
+//   node benchsh9.js [nkeys]
+const Module = require('./sh9.js')
+const Stringhash9Batch = require('./sh9batch.js')
+const Stringhash9Stream = require('./sh9stream.js')
+const { Readable, Writable, pipeline } = require('stream')
+
+var NKEYS = parseInt(process.argv[2]) || 2000000;
+
+Module.onRuntimeInitialized = function() {
+
+ try {
+   Stringhash9Batch.requireExports(Module, ['_stringhash9a_set_batch',
+                                            '_stringhash9a_bulk_load',
+                                            '_stringhash9a_set_framed']);
+ } catch (err) {
+   console.error("benchsh9: " + err.message);
+   process.exit(1);
+ }
+
+ var keys = new Array(NKEYS);
+ for (var i = 0; i < NKEYS; i++) {
+   keys[i] = "key:" + (i * 2654435761 % 1000003);
+ }
+
+ var MAXBYTES = 64
+ var dataPtr = Module._malloc(MAXBYTES);
+
+ function run_wrapper(sh) {
+   var found = 0;
+   for (var i = 0; i < keys.length; i++) {
+     let strlen = Module.stringToUTF8(keys[i], dataPtr, MAXBYTES);
+     found += Module._stringhash9a_set(sh, dataPtr, strlen);
+   }
+   return found;
+ }
+
+ function run_batch(sh) {
+   var batch = new Stringhash9Batch(Module, sh);
+   var results = batch.set(keys);
+   batch.free();
+   var found = 0;
+   for (var i = 0; i < results.length; i++) {
+     found += results[i];
+   }
+   return found;
+ }
+
+ //same keys through stringhash9a_bulk_load
+ function run_load(sh) {
+   var batch = new Stringhash9Batch(Module, sh);
+   var found = batch.load(keys);
+   batch.free();
+   return found;
+ }
+
+ function bench(name, fn) {
+   var sh = Module._stringhash9a_create(NKEYS);
+   var start = process.hrtime.bigint();
+   var found = fn(sh);
+   var ns = Number(process.hrtime.bigint() - start);
+   Module._stringhash9a_destroy(sh);
+   console.log(name + ": " + (NKEYS * 1e3 / ns).toFixed(2) + " Mkeys/s, " +
+               found + " found");
+ }
+
+ //newline framed Buffers in 64KB chunks, as they would come off a socket
+ function bench_stream() {
+   var text = Buffer.from(keys.join("\n") + "\n");
+   var chunks = [];
+   for (var off = 0; off < text.length; off += 65536) {
+     chunks.push(text.subarray(off, off + 65536));
+   }
+   var sh = Module._stringhash9a_create(NKEYS);
+   var out = 0;
+   var start = process.hrtime.bigint();
+   pipeline(Readable.from(chunks), new Stringhash9Stream(Module, sh),
+            new Writable({ write(buf, enc, done) { out += buf.length; done(); } }),
+            function(err) {
+     var ns = Number(process.hrtime.bigint() - start);
+     Module._stringhash9a_destroy(sh);
+     console.log("stream : " + (NKEYS * 1e3 / ns).toFixed(2) + " Mkeys/s, " +
+                 (text.length * 1e3 / ns).toFixed(1) + " MB/s, " +
+                 (err ? err.message : out + " bytes out"));
+   });
+ }
+
+ bench("wrapper", run_wrapper);
+ bench("batch  ", run_batch);
+ bench("load   ", run_load);
+ bench_stream();
+};
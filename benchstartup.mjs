@@ -0,0 +1,70 @@
+//startup metrics: module size and time until a table can be used, for the
+// full emscripten build (sh9.js/sh9.wasm, runs main) and the lean build
+// (sh9lean.wasm via sh9.mjs).  exits non-zero if sh9lean.wasm is missing
+//   node benchstartup.mjs
+import { statSync } from 'fs';
+import { createRequire } from 'module';
+import { loadStringhash9a } from './sh9.mjs';
+
+const require = createRequire(import.meta.url);
+
+function size(file) {
+ try {
+   return statSync(new URL(file, import.meta.url)).size;
+ } catch (e) {
+   return NaN;
+ }
+}
+
+function ms(start) {
+ return (Number(process.hrtime.bigint() - start) / 1e6).toFixed(2);
+}
+
+async function full() {
+ //keep the output of main() out of the metrics
+ const log = console.log;
+ const warn = console.warn;
+ console.log = console.warn = function() {};
+ const start = process.hrtime.bigint();
+ const Module = require('./sh9.js');
+ await new Promise((resolve) => { Module.onRuntimeInitialized = resolve; });
+ const sh = Module._stringhash9a_create(100000);
+ console.log = log;
+ console.warn = warn;
+ console.log("full: " + (size('./sh9.js') + size('./sh9.wasm')) + " bytes, " +
+             ms(start) + " ms to first table");
+ Module._stringhash9a_destroy(sh);
+}
+
+async function lean() {
+ if (isNaN(size('./sh9lean.wasm'))) {
+   console.error("lean: sh9lean.wasm not found, rebuild required - build it with the emcc" +
+                 " command under Lean standalone module in README.md");
+   process.exitCode = 1;
+   return;
+ }
+ const start = process.hrtime.bigint();
+ const sh9 = await loadStringhash9a();
+ const sh = sh9.create(100000);
+ console.log("lean: " + (size('./sh9.mjs') + size('./sh9lean.wasm')) + " bytes, " +
+             ms(start) + " ms to first table");
+ sh.destroy();
+}
+
+//run one or the other per process so neither warms the other up
+if (process.argv[2] === 'full') {
+ await full();
+} else if (process.argv[2] === 'lean') {
+ await lean();
+} else {
+ const { execFileSync } = await import('child_process');
+ for (const mode of ['full', 'lean']) {
+   try {
+     process.stdout.write(execFileSync(process.execPath,
+       [new URL(import.meta.url).pathname, mode], { stdio: ['ignore', 'pipe', 'inherit'] }));
+   } catch (e) {
+     process.stdout.write(e.stdout || '');
+     process.exitCode = 1;
+   }
+ }
+}
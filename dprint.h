@@ -25,8 +25,10 @@ SOFTWARE.
 #define _DPRINT_H
 
 #include <stdint.h>
-#include <stdio.h>
 #include <stdlib.h>
+#ifdef DEBUG
+#include <stdio.h>
+#endif
 
 
 // Best to define this in specific source files of interest!
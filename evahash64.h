@@ -53,4 +53,180 @@ static inline uint64_t evahash64(uint8_t *k, uint32_t length, uint32_t initval)
     return ((uint64_t)a<<32) | ((uint64_t)c);
 }
 
+/* incremental form of evahash64 for keys split over several buffers..
+   init, update once per segment, then final gives the same value as
+   evahash64 over the concatenated segments */
+typedef struct _evahash64_state_t {
+    uint32_t a, b, c;
+    uint32_t length;
+    uint32_t buflen;
+    uint8_t buf[12];
+} evahash64_state_t;
+
+static inline void evahash64_init(evahash64_state_t *st, uint32_t initval) {
+    st->a = st->b = 0x9e3779b9;
+    st->c = initval;
+    st->length = 0;
+    st->buflen = 0;
+}
+
+#define evahash64_block(a,b,c,k) \
+{ \
+  a+=(k[0]+((uint32_t)k[1]<<8)+((uint32_t)k[2]<<16) +((uint32_t)k[3]<<24)); \
+  b+=(k[4]+((uint32_t)k[5]<<8)+((uint32_t)k[6]<<16) +((uint32_t)k[7]<<24)); \
+  c+=(k[8]+((uint32_t)k[9]<<8)+((uint32_t)k[10]<<16)+((uint32_t)k[11]<<24)); \
+  evahash64_mix(a,b,c); \
+}
+
+static inline void evahash64_update(evahash64_state_t *st, uint8_t *k, uint32_t len) {
+    uint32_t a = st->a, b = st->b, c = st->c;
+
+    st->length += len;
+
+    /* top up a partial block left over from the last segment */
+    if (st->buflen) {
+        while (len && st->buflen < 12) {
+            st->buf[st->buflen++] = *k++;
+            len--;
+        }
+        if (st->buflen < 12) {
+            return;
+        }
+        uint8_t *p = st->buf;
+        evahash64_block(a,b,c,p);
+        st->buflen = 0;
+    }
+    while (len >= 12) {
+        evahash64_block(a,b,c,k);
+        k += 12; len -= 12;
+    }
+    while (len) {
+        st->buf[st->buflen++] = *k++;
+        len--;
+    }
+    st->a = a; st->b = b; st->c = c;
+}
+
+static inline uint64_t evahash64_final(evahash64_state_t *st) {
+    uint32_t a = st->a, b = st->b, c = st->c;
+    uint8_t *k = st->buf;
+
+    c += st->length;
+    switch(st->buflen) {
+    case 11: c+=((uint32_t)k[10]<<24);
+    case 10: c+=((uint32_t)k[9]<<16);
+    case 9 : c+=((uint32_t)k[8]<<8);
+    case 8 : b+=((uint32_t)k[7]<<24);
+    case 7 : b+=((uint32_t)k[6]<<16);
+    case 6 : b+=((uint32_t)k[5]<<8);
+    case 5 : b+=k[4];
+    case 4 : a+=((uint32_t)k[3]<<24);
+    case 3 : a+=((uint32_t)k[2]<<16);
+    case 2 : a+=((uint32_t)k[1]<<8);
+    case 1 : a+=k[0];
+    }
+    evahash64_mix(a,b,c);
+
+    return ((uint64_t)a<<32) | ((uint64_t)c);
+}
+
+/* multi-lane evahash64 for batches of keys that share a length.. hashes
+   EVAHASH64_LANES keys at once, one per vector lane, and gives the same
+   values as evahash64 on each key.  written with gcc/clang vector
+   extensions so the compiler picks the instruction set: sse2 by default on
+   x86-64, avx2 or avx-512 with -mavx2 / -mavx512f, simd128 on wasm with
+   -msimd128.  8 lanes suits avx2, 4 fits one sse or simd128 register and 16
+   one avx-512 register */
+#ifndef EVAHASH64_LANES
+#define EVAHASH64_LANES 8
+#endif
+
+/* little endian word at k, as the scalar loop reads it */
+#define evahash64_word(k) \
+  ((k)[0]+((uint32_t)(k)[1]<<8)+((uint32_t)(k)[2]<<16)+((uint32_t)(k)[3]<<24))
+
+#if defined(__GNUC__) && !defined(EVAHASH64_NO_VECTOR)
+#include <string.h>
+
+typedef uint32_t evahash64_vec_t __attribute__((vector_size(EVAHASH64_LANES * 4)));
+
+/* little endian word from the first n (0..4) bytes at k */
+static inline uint32_t evahash64_part(uint8_t *k, uint32_t n) {
+    switch (n) {
+    case 0: return 0;
+    case 1: return k[0];
+    case 2: return k[0]+((uint32_t)k[1]<<8);
+    case 3: return k[0]+((uint32_t)k[1]<<8)+((uint32_t)k[2]<<16);
+    default: return evahash64_word(k);
+    }
+}
+
+static inline void evahash64_lanes(uint8_t **keys, uint32_t length,
+                                   uint32_t initval, uint64_t *out) {
+    evahash64_vec_t a, b, c;
+    uint32_t wa[EVAHASH64_LANES], wb[EVAHASH64_LANES], wc[EVAHASH64_LANES];
+    evahash64_vec_t va, vb, vc;
+    uint32_t off = 0;
+    uint32_t len = length;
+    int i;
+
+    for (i = 0; i < EVAHASH64_LANES; i++) {
+        wa[i] = 0x9e3779b9;
+        wc[i] = initval;
+    }
+    memcpy(&a, wa, sizeof(a));
+    memcpy(&c, wc, sizeof(c));
+    b = a;
+
+    /* words are gathered into plain arrays and loaded whole, which
+       compilers turn into vector loads rather than per-lane inserts */
+    while (len >= 12) {
+        for (i = 0; i < EVAHASH64_LANES; i++) {
+            uint8_t *k = keys[i] + off;
+            wa[i] = evahash64_word(k);
+            wb[i] = evahash64_word(k + 4);
+            wc[i] = evahash64_word(k + 8);
+        }
+        memcpy(&va, wa, sizeof(va));
+        memcpy(&vb, wb, sizeof(vb));
+        memcpy(&vc, wc, sizeof(vc));
+        a += va; b += vb; c += vc;
+        evahash64_mix(a,b,c);
+        off += 12; len -= 12;
+    }
+
+    /* tail bytes zero padded to a block.. c skips its low byte, which the
+       length takes, just like the scalar switch */
+    uint32_t na = (len > 4) ? 4 : len;
+    uint32_t nb = (len > 8) ? 4 : ((len > 4) ? len - 4 : 0);
+    uint32_t nc = (len > 8) ? len - 8 : 0;
+    for (i = 0; i < EVAHASH64_LANES; i++) {
+        uint8_t *k = keys[i] + off;
+        wa[i] = evahash64_part(k, na);
+        wb[i] = evahash64_part(k + 4, nb);
+        wc[i] = evahash64_part(k + 8, nc) << 8;
+    }
+    memcpy(&va, wa, sizeof(va));
+    memcpy(&vb, wb, sizeof(vb));
+    memcpy(&vc, wc, sizeof(vc));
+    c += length;
+    a += va; b += vb; c += vc;
+    evahash64_mix(a,b,c);
+
+    memcpy(wa, &a, sizeof(a));
+    memcpy(wc, &c, sizeof(c));
+    for (i = 0; i < EVAHASH64_LANES; i++) {
+        out[i] = ((uint64_t)wa[i]<<32) | ((uint64_t)wc[i]);
+    }
+}
+#else
+static inline void evahash64_lanes(uint8_t **keys, uint32_t length,
+                                   uint32_t initval, uint64_t *out) {
+    int i;
+    for (i = 0; i < EVAHASH64_LANES; i++) {
+        out[i] = evahash64(keys[i], length, initval);
+    }
+}
+#endif
+
 #endif // _EVAHASH64_H
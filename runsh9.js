@@ -11,9 +11,8 @@ Module.onRuntimeInitialized = function() {
 
  function stringhash9_set(str) {
    //copy string onto allocated memory buffer
-   let strlen = Module.lengthBytesUTF8(str);
-   strlen = (strlen <= MAXBYTES) ? strlen : MAXBYTES;
-   Module.stringToUTF8(str, dataPtr, MAXBYTES);
+   // (at most MAXBYTES-1 bytes plus a NUL - the key is the bytes written)
+   let strlen = Module.stringToUTF8(str, dataPtr, MAXBYTES);
 
    //call stringhash with pointer in C-code
    return Module._stringhash9a_set(sh, dataPtr, strlen);
@@ -0,0 +1,134 @@
+//ES module wrapper for the lean standalone build (sh9lean.wasm)
+// no emscripten runtime and nothing runs at startup - tables are only
+// created when asked for.
+// usage:
+//   import { loadStringhash9a } from './sh9.mjs';
+//   const sh9 = await loadStringhash9a();
+//   const sh = sh9.create(100000);
+//   sh.set("mystring");   //0 - first time seen
+//   sh.set("mystring");   //1
+
+const MAXBYTES = 64;
+const MAXKEYBYTES = MAXBYTES - 1;  //same cap as the sh9.js wrappers (stringToUTF8 keeps a byte for the NUL)
+
+//imports a standalone build may ask for.  memory growth notifications and
+// large copies happen in normal use and get real implementations; the wasi
+// calls are only reached on abort/exit paths, so they throw.  anything else
+// is refused when the module is loaded rather than when it is first called
+const UNREACHABLE = {
+ env: ['abort', '__assert_fail'],
+ wasi_snapshot_preview1: ['proc_exit', 'fd_write', 'fd_close', 'fd_seek']
+};
+
+function makeImports(state) {
+ const env = {
+   //memory.grow ran inside the module.. heap views are refreshed lazily
+   emscripten_notify_memory_growth: () => {},
+   emscripten_memcpy_big: (dest, src, num) => {
+     new Uint8Array(state.memory.buffer).copyWithin(dest, src, src + num);
+   }
+ };
+ const imports = { env: env, wasi_snapshot_preview1: {} };
+ for (const module of Object.keys(UNREACHABLE)) {
+   for (const name of UNREACHABLE[module]) {
+     imports[module][name] = () => {
+       throw new Error("sh9lean: unexpected call to " + module + "." + name);
+     };
+   }
+ }
+ return imports;
+}
+
+function checkImports(module, imports) {
+ for (const imp of WebAssembly.Module.imports(module)) {
+   if (imp.kind !== 'function' || !imports[imp.module] ||
+       typeof imports[imp.module][imp.name] !== 'function') {
+     throw new Error("sh9lean: unsupported import " + imp.module + "." + imp.name);
+   }
+ }
+}
+
+function isResponse(source) {
+ return (typeof Response !== 'undefined') && (source instanceof Response);
+}
+
+async function compile(source) {
+ if (typeof process !== 'undefined' && process.versions && process.versions.node &&
+     !isResponse(source)) {
+   //node cannot fetch file: urls.. read the bytes instead
+   const { readFile } = await import('fs/promises');
+   return WebAssembly.compile(await readFile(source || new URL('./sh9lean.wasm', import.meta.url)));
+ }
+ const response = isResponse(source) ? source :
+   fetch(source || new URL('./sh9lean.wasm', import.meta.url));
+ return WebAssembly.compileStreaming(response);
+}
+
+async function instantiate(source) {
+ const module = await compile(source);
+ const state = {};
+ const imports = makeImports(state);
+ checkImports(module, imports);
+ const instance = await WebAssembly.instantiate(module, imports);
+ state.memory = instance.exports.memory;
+ return instance;
+}
+
+//exports the wrapper calls.. a sh9lean.wasm built from an older command
+// line lacks some of them, which would otherwise only show up on first use
+const EXPORTS = ['memory', 'malloc', 'stringhash9a_create', 'stringhash9a_set',
+                 'stringhash9a_check', 'stringhash9a_set_get_age',
+                 'stringhash9a_check_get_age', 'stringhash9a_delete',
+                 'stringhash9a_flush', 'stringhash9a_destroy'];
+
+export async function loadStringhash9a(source) {
+ const instance = await instantiate(source);
+ const wasm = instance.exports;
+ const missing = EXPORTS.filter((name) => !(name in wasm));
+ if (missing.length) {
+   throw new Error("rebuild required: sh9lean.wasm was built without " + missing.join(", ") +
+                   " - rebuild it with the emcc command under Lean standalone module in README.md");
+ }
+ if (wasm._initialize) {
+   wasm._initialize();
+ }
+
+ const encoder = new TextEncoder();
+ const dataPtr = wasm.malloc(MAXBYTES);
+ let heap = new Uint8Array(wasm.memory.buffer);
+
+ //copy a string or byte view into the scratch buffer, returns its length
+ function stage(key) {
+   if (heap.buffer !== wasm.memory.buffer) {
+     heap = new Uint8Array(wasm.memory.buffer);   //memory grew
+   }
+   const dst = heap.subarray(dataPtr, dataPtr + MAXKEYBYTES);
+   if (typeof key === 'string') {
+     return encoder.encodeInto(key, dst).written;
+   }
+   const len = Math.min(key.length, MAXKEYBYTES);
+   dst.set(key.subarray(0, len));
+   return len;
+ }
+
+ return {
+   exports: wasm,
+   create(maxRecords) {
+     const sh = wasm.stringhash9a_create(maxRecords);
+     if (!sh) {
+       throw new Error("stringhash9a_create failed");
+     }
+     return {
+       ptr: sh,
+       set: (key) => wasm.stringhash9a_set(sh, dataPtr, stage(key)),
+       check: (key) => wasm.stringhash9a_check(sh, dataPtr, stage(key)),
+       //-1 if new/absent, else approximate epochs since last seen
+       setAge: (key) => wasm.stringhash9a_set_get_age(sh, dataPtr, stage(key)),
+       checkAge: (key) => wasm.stringhash9a_check_get_age(sh, dataPtr, stage(key)),
+       delete: (key) => wasm.stringhash9a_delete(sh, dataPtr, stage(key)),
+       flush: () => wasm.stringhash9a_flush(sh),
+       destroy: () => wasm.stringhash9a_destroy(sh)
+     };
+   }
+ };
+}
@@ -0,0 +1,119 @@
+//batched string keys for stringhash9a
+// strings are encoded with TextEncoder.encodeInto straight into a ring that
+// lives in wasm memory, then the whole ring is handed to C in one call.
+// usage (node):
+//   const Stringhash9Batch = require('./sh9batch.js')
+//   var batch = new Stringhash9Batch(Module, sh);
+//   var results = batch.set(["key1", "key2", ...]);  //Uint8Array, 1 == seen
+
+const RINGBYTES = 1 << 20;
+const MAXKEYS = 1 << 14;
+const LOADKEYS = 1 << 18;  //keys per bulk_load call, SH9A_BULK_CHUNK on the C side
+const MAXBYTES = 64;
+const MAXKEYBYTES = MAXBYTES - 1;  //as stringToUTF8 into a MAXBYTES buffer, which keeps room for a NUL
+
+//an sh9.js built before the batch entry points has no such exports..
+// say so instead of failing later with "fn is not a function"
+function requireExports(Module, names) {
+ var missing = names.filter(function(name) {
+   return typeof Module[name] !== 'function';
+ });
+ if (missing.length) {
+   throw new Error("rebuild required: sh9.js was built without " + missing.join(", ") +
+                   " - rebuild sh9.js/sh9.wasm with the emcc command under Modifications in README.md");
+ }
+}
+
+function Stringhash9Batch(Module, sh, ringbytes, maxkeys) {
+ requireExports(Module, ['_stringhash9a_set_batch', '_stringhash9a_check_batch']);
+ this.Module = Module;
+ this.sh = sh;
+ this.ringbytes = ringbytes || RINGBYTES;
+ this.maxkeys = maxkeys || MAXKEYS;
+ this.ringPtr = Module._malloc(this.ringbytes);
+ this.lensPtr = Module._malloc(this.maxkeys * 4);
+ this.resultsPtr = Module._malloc(this.maxkeys);
+ this.encoder = new TextEncoder();
+}
+
+//encode keys into the ring and submit them in as few calls as possible..
+// keys longer than MAXKEYBYTES bytes are truncated at a character boundary,
+// the same bytes the single key wrapper's stringToUTF8 writes
+Stringhash9Batch.prototype.run = function(fn, keys) {
+ var Module = this.Module;
+ var out = new Uint8Array(keys.length);
+ var done = 0;
+
+ while (done < keys.length) {
+   //heap views can be replaced when memory grows, so fetch them per batch
+   var heap = Module.HEAPU8;
+   var lens = Module.HEAPU32.subarray(this.lensPtr >> 2,
+                                      (this.lensPtr >> 2) + this.maxkeys);
+   var off = 0;
+   var n = 0;
+
+   while (done + n < keys.length && n < this.maxkeys &&
+          off + MAXBYTES <= this.ringbytes) {
+     var dst = heap.subarray(this.ringPtr + off, this.ringPtr + off + MAXKEYBYTES);
+     var len = this.encoder.encodeInto(keys[done + n], dst).written;
+     lens[n++] = len;
+     off += len;
+   }
+
+   fn(this.sh, this.ringPtr, this.lensPtr, n, this.resultsPtr);
+   out.set(Module.HEAPU8.subarray(this.resultsPtr, this.resultsPtr + n), done);
+   done += n;
+ }
+ return out;
+};
+
+Stringhash9Batch.prototype.set = function(keys) {
+ return this.run(this.Module._stringhash9a_set_batch, keys);
+};
+
+Stringhash9Batch.prototype.check = function(keys) {
+ return this.run(this.Module._stringhash9a_check_batch, keys);
+};
+
+//build up a table from a large key list with stringhash9a_bulk_load..
+// returns the number of keys that were already present, and throws if wasm
+// memory runs out for bulk_load's scratch space.  keys are staged
+// LOADKEYS at a time in a scratch ring of their own - bulk_load sorts each
+// call's keys by bucket, and calls the size of the normal ring would leave
+// too few keys per bucket range to gain any locality
+Stringhash9Batch.prototype.load = function(keys) {
+ var Module = this.Module;
+ requireExports(Module, ['_stringhash9a_bulk_load']);
+ var sh = this.sh;
+ var found = 0;
+ var n = Math.min(keys.length, LOADKEYS);
+ if (!n) {
+   return 0;
+ }
+ var loader = new Stringhash9Batch(Module, sh, n * MAXBYTES, n);
+ try {
+   //results are not reported per key, so the results buffer is unused
+   loader.run(function(s, ring, lens, cnt) {
+     var r = Module._stringhash9a_bulk_load(sh, ring, lens, cnt);
+     if (r < 0) {
+       throw new Error("sh9batch: stringhash9a_bulk_load could not allocate its scratch space");
+     }
+     found += r;
+   }, keys);
+ } finally {
+   loader.free();
+ }
+ return found;
+};
+
+Stringhash9Batch.prototype.free = function() {
+ this.Module._free(this.ringPtr);
+ this.Module._free(this.lensPtr);
+ this.Module._free(this.resultsPtr);
+};
+
+Stringhash9Batch.requireExports = requireExports;
+
+if (typeof module !== 'undefined') {
+ module.exports = Stringhash9Batch;
+}
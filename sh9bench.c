@@ -0,0 +1,493 @@
+/*
+   benchmarks for stringhash9a.. build with:
+   gcc -O2 -DSH9A_NO_MAIN sh9bench.c stringhash9a.c -o sh9bench -lm
+
+   ./sh9bench [name]   - runs every benchmark when no name is given
+*/
+
+/*
+No copyright is claimed in the United States under Title 17, U.S. Code.
+All Other Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include "stringhash9a.h"
+
+#define BENCH_SEED 0x5eed9a
+
+static double now_sec(void) {
+     struct timespec ts;
+     clock_gettime(CLOCK_MONOTONIC, &ts);
+     return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+//insert n sequential keys, then check them all back.. reports insert
+// throughput, drops and the fraction of inserted keys still present
+static void bench_fill(const char * name, stringhash9a_t * sht, uint32_t n) {
+     uint32_t i;
+     uint32_t present = 0;
+
+     double start = now_sec();
+     for (i = 0; i < n; i++) {
+          stringhash9a_set(sht, &i, 4);
+     }
+     double elapsed = now_sec() - start;
+
+     for (i = 0; i < n; i++) {
+          present += stringhash9a_check(sht, &i, 4);
+     }
+     printf("  %-8s %7.2f Mset/s  drops %9"PRIu64" (%6.3f%%)  present %7.3f%%\n",
+            name, n / elapsed / 1e6, stringhash9a_drop_cnt(sht),
+            (double)stringhash9a_drop_cnt(sht) * 100 / n,
+            (double)present * 100 / n);
+}
+
+//drop rate and throughput at high load factors, with and without the
+// overflow stash
+static void bench_stash(void) {
+     static const double loads[] = {0.80, 0.90, 0.95, 1.00, 1.10};
+     uint32_t i;
+
+     printf("stash: load factor vs drops\n");
+     for (i = 0; i < sizeof(loads)/sizeof(loads[0]); i++) {
+          stringhash9a_t * plain = stringhash9a_create_seed(4000000, BENCH_SEED);
+          stringhash9a_t * stash = stringhash9a_create_seed(4000000, BENCH_SEED);
+          if (!plain || !stash || !stringhash9a_enable_stash(stash)) {
+               printf("unable to allocate\n");
+               return;
+          }
+          uint32_t n = (uint32_t)(plain->max_records * loads[i]);
+          printf(" load %.2f (%u keys)\n", loads[i], n);
+          bench_fill("plain", plain, n);
+          bench_fill("stash", stash, n);
+          stringhash9a_destroy(plain);
+          stringhash9a_destroy(stash);
+     }
+}
+
+//usable load factor in cuckoo mode vs plain two-choice at the same memory
+static void bench_cuckoo(void) {
+     static const double loads[] = {0.95, 0.98, 0.99, 1.00, 1.05};
+     uint32_t i;
+
+     printf("cuckoo: load factor vs drops\n");
+     for (i = 0; i < sizeof(loads)/sizeof(loads[0]); i++) {
+          stringhash9a_t * plain = stringhash9a_create_seed(4000000, BENCH_SEED);
+          stringhash9a_t * cuckoo = stringhash9a_create_mode(4000000, SH9A_MODE_CUCKOO);
+          if (!plain || !cuckoo) {
+               printf("unable to allocate\n");
+               return;
+          }
+          cuckoo->hash_seed = BENCH_SEED;
+          uint32_t n = (uint32_t)(plain->max_records * loads[i]);
+          printf(" load %.2f (%u keys)\n", loads[i], n);
+          bench_fill("plain", plain, n);
+          bench_fill("cuckoo", cuckoo, n);
+          printf("  %-8s %7.3f kicks per insert\n", "", (double)cuckoo->kicks / n);
+          stringhash9a_destroy(plain);
+          stringhash9a_destroy(cuckoo);
+     }
+}
+
+//probe cost of the default split layout vs blocked two-choice at a DRAM
+// resident size.. misses are the interesting case, they touch both buckets
+static void bench_layout_run(const char * name, stringhash9a_t * sht) {
+     uint32_t n = (uint32_t)(sht->max_records * 0.8);
+     uint32_t i;
+     uint32_t hits = 0;
+     double start = now_sec();
+     for (i = 0; i < n; i++) {
+          uint32_t k = i * 2654435761U;
+          stringhash9a_set(sht, &k, 4);
+     }
+     double set_sec = now_sec() - start;
+
+     start = now_sec();
+     for (i = 0; i < n; i++) {
+          uint64_t k = i;    //8 byte keys, never set
+          hits += stringhash9a_check(sht, &k, 8);
+     }
+     double miss_sec = now_sec() - start;
+
+     printf("  %-8s %7.2f Mset/s  %7.2f Mmiss/s  drops %"PRIu64"  fp %u\n",
+            name, n / set_sec / 1e6, n / miss_sec / 1e6,
+            stringhash9a_drop_cnt(sht), hits);
+}
+
+static void bench_layout(void) {
+     uint32_t records = 64000000;
+     printf("layout: %u records\n", records);
+     stringhash9a_t * sht = stringhash9a_create_seed(records, BENCH_SEED);
+     if (!sht) {
+          printf("unable to allocate\n");
+          return;
+     }
+     printf("  table %"PRIu64" MB\n", sht->mem_used >> 20);
+     bench_layout_run("split", sht);
+     stringhash9a_destroy(sht);
+
+     sht = stringhash9a_create_mode(records, SH9A_MODE_BLOCKED);
+     if (!sht) {
+          printf("unable to allocate\n");
+          return;
+     }
+     sht->hash_seed = BENCH_SEED;
+     bench_layout_run("blocked", sht);
+     stringhash9a_destroy(sht);
+}
+
+//false positives over keys never set, with and without the verify arena..
+// reports throughput and memory as well since verify trades both for exactness
+static void bench_verify_run(const char * name, stringhash9a_t * sht) {
+     uint32_t n = sht->max_records;
+     uint32_t i;
+     uint32_t hits = 0;
+     double start = now_sec();
+     for (i = 0; i < n; i++) {
+          stringhash9a_set(sht, &i, 4);
+     }
+     double set_sec = now_sec() - start;
+
+     start = now_sec();
+     for (i = 0; i < n; i++) {
+          uint64_t k = i;    //8 byte keys, never set
+          hits += stringhash9a_check(sht, &k, 8);
+     }
+     double miss_sec = now_sec() - start;
+
+     printf("  %-8s %7.2f Mset/s  %7.2f Mmiss/s  fp %6u  rejects %6"PRIu64"  mem %5"PRIu64" MB\n",
+            name, n / set_sec / 1e6, n / miss_sec / 1e6, hits,
+            sht->verify_rejects, sht->mem_used >> 20);
+}
+
+static void bench_verify(void) {
+     uint32_t records = 4000000;
+     printf("verify: %u records, %u absent probes\n", records, records);
+     stringhash9a_t * plain = stringhash9a_create_seed(records, BENCH_SEED);
+     stringhash9a_t * verify = stringhash9a_create_seed(records, BENCH_SEED);
+     if (!plain || !verify || !stringhash9a_enable_verify(verify)) {
+          printf("unable to allocate\n");
+          return;
+     }
+     bench_verify_run("plain", plain);
+     bench_verify_run("verify", verify);
+     stringhash9a_destroy(plain);
+     stringhash9a_destroy(verify);
+}
+
+//serial stringhash9a_set loop vs stringhash9a_bulk_load on the same keys,
+// at a size well past the caches
+static void bench_bulk(void) {
+     uint32_t n = 16000000;
+     uint32_t i;
+     uint32_t * keys = (uint32_t *)malloc(sizeof(uint32_t) * n);
+     uint32_t * lens = (uint32_t *)malloc(sizeof(uint32_t) * n);
+     stringhash9a_t * serial = stringhash9a_create_seed(n, BENCH_SEED);
+     stringhash9a_t * bulk = stringhash9a_create_seed(n, BENCH_SEED);
+     if (!keys || !lens || !serial || !bulk) {
+          printf("unable to allocate\n");
+          return;
+     }
+     for (i = 0; i < n; i++) {
+          keys[i] = i * 2654435761U;
+          lens[i] = 4;
+     }
+     printf("bulk: %u keys, table %"PRIu64" MB\n", n, serial->mem_used >> 20);
+
+     double start = now_sec();
+     for (i = 0; i < n; i++) {
+          stringhash9a_set(serial, &keys[i], 4);
+     }
+     double serial_sec = now_sec() - start;
+
+     start = now_sec();
+     stringhash9a_bulk_load(bulk, (uint8_t *)keys, lens, n);
+     double bulk_sec = now_sec() - start;
+
+     uint32_t mismatch = 0;
+     for (i = 0; i < n; i++) {
+          mismatch += stringhash9a_check(serial, &keys[i], 4) !=
+               stringhash9a_check(bulk, &keys[i], 4);
+     }
+     printf("  %-8s %7.2f Mset/s  drops %"PRIu64"\n", "serial",
+            n / serial_sec / 1e6, stringhash9a_drop_cnt(serial));
+     printf("  %-8s %7.2f Mset/s  drops %"PRIu64"  membership mismatches %u\n",
+            "bulk", n / bulk_sec / 1e6, stringhash9a_drop_cnt(bulk), mismatch);
+     stringhash9a_destroy(serial);
+     stringhash9a_destroy(bulk);
+     free(keys);
+     free(lens);
+}
+
+//newline framed log lines through stringhash9a_set_framed, the path the
+// node stream takes, in 1MB chunks with partial records carried over
+static void bench_framed(void) {
+     uint32_t nlines = 8000000;
+     uint32_t chunk = 1 << 20;
+     uint32_t i;
+     uint64_t total = 0;
+     uint32_t maxrecs = chunk / 8;
+     uint8_t * text = (uint8_t *)malloc((uint64_t)nlines * 48);
+     uint32_t * offs = (uint32_t *)malloc(sizeof(uint32_t) * maxrecs);
+     uint32_t * lens = (uint32_t *)malloc(sizeof(uint32_t) * maxrecs);
+     uint8_t * results = (uint8_t *)malloc(maxrecs);
+     stringhash9a_t * sht = stringhash9a_create_seed(nlines, BENCH_SEED);
+     if (!text || !offs || !lens || !results || !sht) {
+          printf("unable to allocate\n");
+          return;
+     }
+     for (i = 0; i < nlines; i++) {
+          uint32_t item = (i * 2654435761U) % 2000000;
+          total += sprintf((char *)text + total,
+                           "2024-01-01T00:00:00 host%02u GET /item/%u\n",
+                           item % 50, item);
+     }
+
+     uint64_t pos = 0;
+     uint64_t recs = 0;
+     uint64_t firsts = 0;
+     double start = now_sec();
+     while (pos < total) {
+          uint32_t len = (total - pos < chunk) ? (uint32_t)(total - pos) : chunk;
+          uint32_t consumed;
+          int n = stringhash9a_set_framed(sht, text + pos, len, SH9A_FRAME_NEWLINE,
+                                          offs, lens, results, maxrecs, &consumed);
+          int j;
+          for (j = 0; j < n; j++) {
+               firsts += !results[j];
+          }
+          recs += n;
+          pos += consumed;
+     }
+     double elapsed = now_sec() - start;
+     printf("framed: %u lines, %"PRIu64" MB\n", nlines, total >> 20);
+     printf("  %7.1f MB/s  %7.2f Mrec/s  first seen %"PRIu64" of %"PRIu64"\n",
+            total / elapsed / 1e6, recs / elapsed / 1e6, firsts, recs);
+     stringhash9a_destroy(sht);
+     free(text);
+     free(offs);
+     free(lens);
+     free(results);
+}
+
+//scalar evahash64 vs the multi-lane kernel on short fixed length keys, then
+// stringhash9a_set in a loop vs stringhash9a_set_batch, which uses it
+static void bench_lanes(void) {
+     static const uint32_t keylens[] = {4, 8, 16};
+     uint32_t n = 1 << 24;
+     uint32_t i, l;
+     uint8_t * data = (uint8_t *)malloc((uint64_t)n * 16);
+     uint32_t * lens = (uint32_t *)malloc(sizeof(uint32_t) * n);
+     uint8_t * results = (uint8_t *)malloc(n);
+     if (!data || !lens || !results) {
+          printf("unable to allocate\n");
+          return;
+     }
+     uint64_t x = BENCH_SEED;
+     for (i = 0; i < n * 16; i++) {
+          x ^= x << 13;
+          x ^= x >> 7;
+          x ^= x << 17;
+          data[i] = (uint8_t)x;
+     }
+     printf("lanes: %u keys, %d lanes\n", n, EVAHASH64_LANES);
+     for (l = 0; l < sizeof(keylens)/sizeof(keylens[0]); l++) {
+          uint32_t len = keylens[l];
+          uint64_t sum = 0;
+          double start = now_sec();
+          for (i = 0; i < n; i++) {
+               sum += evahash64(data + (uint64_t)i * len, len, BENCH_SEED);
+          }
+          double scalar_sec = now_sec() - start;
+
+          uint64_t lsum = 0;
+          uint8_t * keys[EVAHASH64_LANES];
+          uint64_t out[EVAHASH64_LANES];
+          start = now_sec();
+          for (i = 0; i + EVAHASH64_LANES <= n; i += EVAHASH64_LANES) {
+               int j;
+               for (j = 0; j < EVAHASH64_LANES; j++) {
+                    keys[j] = data + (uint64_t)(i + j) * len;
+               }
+               evahash64_lanes(keys, len, BENCH_SEED, out);
+               for (j = 0; j < EVAHASH64_LANES; j++) {
+                    lsum += out[j];
+               }
+          }
+          double lane_sec = now_sec() - start;
+          printf("  %2u bytes  scalar %7.1f Mhash/s  lanes %7.1f Mhash/s  %s\n", len,
+                 n / scalar_sec / 1e6, n / lane_sec / 1e6,
+                 (sum == lsum) ? "match" : "MISMATCH");
+     }
+
+     uint32_t nset = 4000000;
+     for (i = 0; i < nset; i++) {
+          lens[i] = 4;
+     }
+     stringhash9a_t * serial = stringhash9a_create_seed(nset, BENCH_SEED);
+     stringhash9a_t * batch = stringhash9a_create_seed(nset, BENCH_SEED);
+     if (!serial || !batch) {
+          printf("unable to allocate\n");
+          return;
+     }
+     double start = now_sec();
+     for (i = 0; i < nset; i++) {
+          stringhash9a_set(serial, data + (uint64_t)i * 4, 4);
+     }
+     double serial_sec = now_sec() - start;
+     start = now_sec();
+     stringhash9a_set_batch(batch, data, lens, nset, results);
+     double batch_sec = now_sec() - start;
+     printf("  set loop %7.2f Mset/s  set_batch %7.2f Mset/s  (4 byte keys)\n",
+            nset / serial_sec / 1e6, nset / batch_sec / 1e6);
+     stringhash9a_destroy(serial);
+     stringhash9a_destroy(batch);
+     free(data);
+     free(lens);
+     free(results);
+}
+
+//draw n ranks from a Zipf(skew) distribution over universe keys
+static uint32_t * zipf_ranks(uint32_t universe, double skew, uint32_t n) {
+     double * cdf = (double *)malloc(sizeof(double) * universe);
+     uint32_t * ranks = (uint32_t *)malloc(sizeof(uint32_t) * n);
+     uint64_t x = BENCH_SEED;
+     uint32_t i;
+     if (!cdf || !ranks) {
+          free(cdf);
+          free(ranks);
+          return NULL;
+     }
+     double sum = 0;
+     for (i = 0; i < universe; i++) {
+          sum += 1.0 / pow(i + 1, skew);
+          cdf[i] = sum;
+     }
+     for (i = 0; i < n; i++) {
+          x ^= x << 13;
+          x ^= x >> 7;
+          x ^= x << 17;
+          double u = (double)(x >> 11) / (double)(1ULL << 53) * sum;
+          uint32_t lo = 0, hi = universe - 1;
+          while (lo < hi) {
+               uint32_t mid = (lo + hi) / 2;
+               if (cdf[mid] < u) {
+                    lo = mid + 1;
+               }
+               else {
+                    hi = mid;
+               }
+          }
+          //spread ranks over the key space so hot keys are not neighbours
+          ranks[i] = lo * 2654435761U;
+     }
+     free(cdf);
+     return ranks;
+}
+
+static void bench_front_run(const char * name, stringhash9a_t * sht,
+                            uint32_t * ranks, uint32_t n, uint32_t set_mask) {
+     uint32_t i;
+     uint32_t found = 0;
+     double start = now_sec();
+     for (i = 0; i < n; i++) {
+          //mostly lookups with some inserts, as a dedup front end sees
+          if ((i & set_mask) == 0) {
+               found += stringhash9a_set(sht, &ranks[i], 4);
+          }
+          else {
+               found += stringhash9a_check(sht, &ranks[i], 4);
+          }
+     }
+     double elapsed = now_sec() - start;
+     printf("  %-8s %7.2f Mops/s  found %u", name, n / elapsed / 1e6, found);
+     if (sht->front) {
+          printf("  front hit rate %5.1f%%",
+                 100.0 * sht->front_hits / (sht->front_lookups ? sht->front_lookups : 1));
+     }
+     printf("\n");
+}
+
+//Zipf traffic with and without the hot key front cache.. the cache only
+// pays once a few keys take most of the traffic and lookups dominate, so
+// the last two runs are check heavy at high skew
+static void bench_front(void) {
+     static const struct {
+          double skew;
+          uint32_t set_mask;  //one set per set_mask + 1 ops
+     } runs[] = {
+          {0.8, 7}, {0.99, 7}, {1.2, 7}, {1.2, 63}, {1.5, 63},
+     };
+     uint32_t universe = 4000000;
+     uint32_t n = 8000000;
+     uint32_t i;
+     printf("front: %u ops over %u keys\n", n, universe);
+     for (i = 0; i < sizeof(runs)/sizeof(runs[0]); i++) {
+          uint32_t * ranks = zipf_ranks(universe, runs[i].skew, n);
+          stringhash9a_t * plain = stringhash9a_create_seed(universe, BENCH_SEED);
+          stringhash9a_t * front = stringhash9a_create_seed(universe, BENCH_SEED);
+          if (!ranks || !plain || !front || !stringhash9a_enable_front(front, 12)) {
+               printf("unable to allocate\n");
+               return;
+          }
+          printf(" zipf %.2f, 1 set in %u\n", runs[i].skew, runs[i].set_mask + 1);
+          bench_front_run("plain", plain, ranks, n, runs[i].set_mask);
+          bench_front_run("front", front, ranks, n, runs[i].set_mask);
+          stringhash9a_destroy(plain);
+          stringhash9a_destroy(front);
+          free(ranks);
+     }
+}
+
+typedef struct _sh9_bench_t {
+     const char * name;
+     void (*run)(void);
+} sh9_bench_t;
+
+static const sh9_bench_t benches[] = {
+     {"stash", bench_stash},
+     {"cuckoo", bench_cuckoo},
+     {"layout", bench_layout},
+     {"verify", bench_verify},
+     {"bulk", bench_bulk},
+     {"framed", bench_framed},
+     {"lanes", bench_lanes},
+     {"front", bench_front},
+};
+
+int main(int argc, char ** argv) {
+     uint32_t i;
+     int ran = 0;
+     for (i = 0; i < sizeof(benches)/sizeof(benches[0]); i++) {
+          if ((argc < 2) || !strcmp(argv[1], benches[i].name)) {
+               benches[i].run();
+               ran = 1;
+          }
+     }
+     if (!ran) {
+          fprintf(stderr, "unknown benchmark %s\n", argv[1]);
+          return -1;
+     }
+     return 0;
+}
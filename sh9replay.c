@@ -0,0 +1,455 @@
+/*
+   replays a stringhash9a operation trace (recorded by a -DSH9A_TRACE build,
+   see stringhash9a_trace_open) against this build.. build with:
+   gcc -O2 -DSH9A_NO_MAIN sh9replay.c stringhash9a.c -o sh9replay
+
+   ./sh9replay trace [options]
+     -plain          start from a default table, not the recorded options
+     -stash -verify -lazy -cuckoo -blocked
+                     turn on a table option for the replay
+     -front bits     hot key front cache of 2^bits entries
+     -records n      table sized for n records instead of the recorded size
+     -seed n         hash seed instead of the recorded one
+     -runs n         throughput runs, the best is reported (default 3)
+
+   the table is rebuilt with the recorded seed and geometry and fed the
+   recorded key hashes, so with the recorded options every result should
+   match.. any difference is reported as divergence
+*/
+
+/*
+No copyright is claimed in the United States under Title 17, U.S. Code.
+All Other Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "stringhash9a.h"
+
+#define REPLAY_OPS 7        //op codes run 1..6
+#define LAT_SUB 8           //latency sub-buckets per power of two
+#define LAT_BUCKETS (64 * LAT_SUB)
+
+static const char * op_names[REPLAY_OPS] = {
+     "?", "set", "check", "age", "delete", "flush", "setage"
+};
+
+typedef struct _replay_opts_t {
+     int plain;
+     uint32_t mode;
+     uint32_t features;
+     uint32_t front_bits;
+     uint64_t records;
+     int seed_set;
+     uint32_t seed;
+     int runs;
+} replay_opts_t;
+
+typedef struct _replay_trace_t {
+     sh9a_trace_header_t hdr;
+     sh9a_trace_rec_t * recs;
+     uint64_t cnt;
+} replay_trace_t;
+
+static uint64_t now_ns(void) {
+     struct timespec ts;
+     clock_gettime(CLOCK_MONOTONIC, &ts);
+     return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+//read the whole trace into memory so the replay does no i/o
+static int load_trace(const char * path, replay_trace_t * tr) {
+     FILE * fp = fopen(path, "rb");
+     uint64_t alloc = 1 << 16;
+     size_t got;
+
+     if (!fp) {
+          fprintf(stderr, "unable to open %s\n", path);
+          return 0;
+     }
+     if ((fread(&tr->hdr, sizeof(tr->hdr), 1, fp) != 1) ||
+         (tr->hdr.magic != SH9A_TRACE_MAGIC)) {
+          fprintf(stderr, "%s is not a stringhash9a trace\n", path);
+          fclose(fp);
+          return 0;
+     }
+     if ((tr->hdr.version != SH9A_TRACE_VERSION) ||
+         (tr->hdr.rec_size != sizeof(sh9a_trace_rec_t))) {
+          fprintf(stderr, "%s is trace version %u, this build reads %u\n",
+                  path, tr->hdr.version, SH9A_TRACE_VERSION);
+          fclose(fp);
+          return 0;
+     }
+
+     tr->cnt = 0;
+     tr->recs = (sh9a_trace_rec_t *)malloc(alloc * sizeof(sh9a_trace_rec_t));
+     while (tr->recs) {
+          got = fread(tr->recs + tr->cnt, sizeof(sh9a_trace_rec_t),
+                      alloc - tr->cnt, fp);
+          tr->cnt += got;
+          if (tr->cnt < alloc) {
+               break;
+          }
+          alloc *= 2;
+          sh9a_trace_rec_t * grown = (sh9a_trace_rec_t *)realloc(tr->recs,
+                                          alloc * sizeof(sh9a_trace_rec_t));
+          if (!grown) {
+               free(tr->recs);
+          }
+          tr->recs = grown;
+     }
+     fclose(fp);
+     if (!tr->recs) {
+          fprintf(stderr, "unable to allocate trace of %s\n", path);
+          return 0;
+     }
+     return 1;
+}
+
+static void print_features(uint32_t features, uint32_t front_bits) {
+     if (!features) {
+          printf(" none");
+     }
+     if (features & SH9A_TRACE_F_STASH) {
+          printf(" stash");
+     }
+     if (features & SH9A_TRACE_F_VERIFY) {
+          printf(" verify");
+     }
+     if (features & SH9A_TRACE_F_LAZY) {
+          printf(" lazy");
+     }
+     if (features & SH9A_TRACE_F_HLL) {
+          printf(" hll");
+     }
+     if (features & SH9A_TRACE_F_FRONT) {
+          printf(" front(%u)", front_bits);
+     }
+}
+
+//a table matching the recorded one, with any overrides applied
+static stringhash9a_t * replay_table(const replay_trace_t * tr,
+                                     const replay_opts_t * o) {
+     const sh9a_trace_header_t * hdr = &tr->hdr;
+     uint32_t mode = (o->plain ? 0 : hdr->mode) | o->mode;
+     uint32_t features = (o->plain ? 0 : hdr->features) | o->features;
+     stringhash9a_t * sht;
+
+     if (o->records) {
+          sht = stringhash9a_create_mode(o->records, mode);
+     }
+     else {
+          //create_records gives back exactly index_size buckets per table
+          sht = stringhash9a_create_records(hdr->index_size * 42);
+          if (sht) {
+               sht->mode = mode;
+          }
+     }
+     if (!sht) {
+          return NULL;
+     }
+     sht->hash_seed = o->seed_set ? o->seed : hdr->hash_seed;
+
+     if (((features & SH9A_TRACE_F_STASH) && !stringhash9a_enable_stash(sht)) ||
+         ((features & SH9A_TRACE_F_VERIFY) && !stringhash9a_enable_verify(sht)) ||
+         ((features & SH9A_TRACE_F_LAZY) && !stringhash9a_enable_lazy_flush(sht)) ||
+         ((features & SH9A_TRACE_F_HLL) &&
+          !stringhash9a_enable_hll(sht, hdr->hll_bits ? hdr->hll_bits : 12)) ||
+         ((features & SH9A_TRACE_F_FRONT) &&
+          !stringhash9a_enable_front(sht, o->front_bits ? o->front_bits :
+                                     hdr->front_bits))) {
+          stringhash9a_destroy(sht);
+          return NULL;
+     }
+     return sht;
+}
+
+static inline int replay_op(stringhash9a_t * sht, const sh9a_trace_rec_t * rec) {
+     switch (rec->op) {
+     case SH9A_TRACE_SET:
+          return stringhash9a_set_hash(sht, rec->hash);
+     case SH9A_TRACE_CHECK:
+          return stringhash9a_check_hash(sht, rec->hash);
+     case SH9A_TRACE_AGE:
+          return stringhash9a_check_get_age_hash(sht, rec->hash);
+     case SH9A_TRACE_DELETE:
+          return stringhash9a_delete_hash(sht, rec->hash);
+     case SH9A_TRACE_FLUSH:
+          stringhash9a_flush(sht);
+          return 0;
+     case SH9A_TRACE_SET_AGE:
+          return stringhash9a_set_get_age_hash(sht, rec->hash);
+     }
+     return rec->result;
+}
+
+static uint32_t lat_bucket(uint64_t ns) {
+     uint32_t log = 3;
+     if (ns < LAT_SUB) {
+          return (uint32_t)ns;
+     }
+     while (ns >> (log + 1)) {
+          log++;
+     }
+     return (log - 2) * LAT_SUB + (uint32_t)((ns >> (log - 3)) & (LAT_SUB - 1));
+}
+
+//smallest latency that lands past bucket b
+static uint64_t lat_upper(uint32_t b) {
+     if (b < LAT_SUB) {
+          return b + 1;
+     }
+     uint32_t log = b / LAT_SUB + 2;
+     return (uint64_t)(LAT_SUB + (b % LAT_SUB) + 1) << (log - 3);
+}
+
+static uint64_t lat_percentile(const uint64_t * hist, uint64_t total, double pct) {
+     uint64_t want = (uint64_t)(total * pct / 100.0);
+     uint64_t seen = 0;
+     uint32_t b;
+     for (b = 0; b < LAT_BUCKETS; b++) {
+          seen += hist[b];
+          if (seen > want) {
+               return lat_upper(b);
+          }
+     }
+     return lat_upper(LAT_BUCKETS - 1);
+}
+
+//cost of reading the clock, taken off every timed op
+static uint64_t timer_overhead(void) {
+     uint64_t best = ~0ULL;
+     int i;
+     for (i = 0; i < 1000; i++) {
+          uint64_t a = now_ns();
+          uint64_t b = now_ns();
+          if (b - a < best) {
+               best = b - a;
+          }
+     }
+     return best;
+}
+
+//full speed runs.. returns the best rate, counts divergence on the first run
+static double replay_throughput(const replay_trace_t * tr, const replay_opts_t * o,
+                                uint64_t * diverge, uint64_t * first,
+                                uint64_t * drops) {
+     double best = 0;
+     int run;
+     uint64_t i;
+
+     for (run = 0; run < o->runs; run++) {
+          stringhash9a_t * sht = replay_table(tr, o);
+          if (!sht) {
+               return -1;
+          }
+          uint64_t start = now_ns();
+          if (run == 0) {
+               for (i = 0; i < tr->cnt; i++) {
+                    const sh9a_trace_rec_t * rec = &tr->recs[i];
+                    if (replay_op(sht, rec) != rec->result) {
+                         if (!diverge[0]) {
+                              *first = i;
+                         }
+                         diverge[0]++;
+                         diverge[rec->op < REPLAY_OPS ? rec->op : 0]++;
+                    }
+               }
+          }
+          else {
+               for (i = 0; i < tr->cnt; i++) {
+                    replay_op(sht, &tr->recs[i]);
+               }
+          }
+          uint64_t elapsed = now_ns() - start;
+          double rate = tr->cnt / (elapsed * 1e-9 + 1e-12);
+          if (rate > best) {
+               best = rate;
+          }
+          *drops = stringhash9a_drop_cnt(sht);
+          stringhash9a_destroy(sht);
+     }
+     return best;
+}
+
+//one more run timing every op on its own
+static int replay_latency(const replay_trace_t * tr, const replay_opts_t * o,
+                          uint64_t * hist, uint64_t * overhead, uint64_t * max) {
+     stringhash9a_t * sht = replay_table(tr, o);
+     uint64_t i;
+     if (!sht) {
+          return 0;
+     }
+     *overhead = timer_overhead();
+     *max = 0;
+     for (i = 0; i < tr->cnt; i++) {
+          uint64_t start = now_ns();
+          replay_op(sht, &tr->recs[i]);
+          uint64_t ns = now_ns() - start;
+          ns = (ns > *overhead) ? ns - *overhead : 0;
+          if (ns > *max) {
+               *max = ns;
+          }
+          hist[lat_bucket(ns)]++;
+     }
+     stringhash9a_destroy(sht);
+     return 1;
+}
+
+static void usage(void) {
+     fprintf(stderr, "usage: sh9replay trace [-plain] [-stash] [-verify] [-lazy] "
+             "[-cuckoo] [-blocked] [-front bits] [-records n] [-seed n] [-runs n]\n");
+}
+
+int main(int argc, char ** argv) {
+     replay_opts_t o;
+     replay_trace_t tr;
+     uint64_t ops[REPLAY_OPS] = {0};
+     uint64_t diverge[REPLAY_OPS] = {0};
+     uint64_t hist[LAT_BUCKETS] = {0};
+     uint64_t recorded_ns = 0;
+     uint64_t first = 0, drops = 0, overhead, max;
+     uint64_t i;
+     int a;
+
+     memset(&o, 0, sizeof(o));
+     o.runs = 3;
+     if (argc < 2) {
+          usage();
+          return -1;
+     }
+     for (a = 2; a < argc; a++) {
+          if (!strcmp(argv[a], "-plain")) {
+               o.plain = 1;
+          }
+          else if (!strcmp(argv[a], "-stash")) {
+               o.features |= SH9A_TRACE_F_STASH;
+          }
+          else if (!strcmp(argv[a], "-verify")) {
+               o.features |= SH9A_TRACE_F_VERIFY;
+          }
+          else if (!strcmp(argv[a], "-lazy")) {
+               o.features |= SH9A_TRACE_F_LAZY;
+          }
+          else if (!strcmp(argv[a], "-cuckoo")) {
+               o.mode |= SH9A_MODE_CUCKOO;
+          }
+          else if (!strcmp(argv[a], "-blocked")) {
+               o.mode |= SH9A_MODE_BLOCKED;
+          }
+          else if (!strcmp(argv[a], "-front") && (a + 1 < argc)) {
+               o.features |= SH9A_TRACE_F_FRONT;
+               o.front_bits = (uint32_t)strtoul(argv[++a], NULL, 0);
+          }
+          else if (!strcmp(argv[a], "-records") && (a + 1 < argc)) {
+               o.records = strtoull(argv[++a], NULL, 0);
+          }
+          else if (!strcmp(argv[a], "-seed") && (a + 1 < argc)) {
+               o.seed_set = 1;
+               o.seed = (uint32_t)strtoul(argv[++a], NULL, 0);
+          }
+          else if (!strcmp(argv[a], "-runs") && (a + 1 < argc)) {
+               o.runs = atoi(argv[++a]);
+               if (o.runs < 1) {
+                    o.runs = 1;
+               }
+          }
+          else {
+               usage();
+               return -1;
+          }
+     }
+
+     if (!load_trace(argv[1], &tr)) {
+          return -1;
+     }
+     for (i = 0; i < tr.cnt; i++) {
+          ops[tr.recs[i].op < REPLAY_OPS ? tr.recs[i].op : 0]++;
+          recorded_ns += tr.recs[i].dt;
+     }
+
+     printf("trace %s: %"PRIu64" ops, seed 0x%08x, %"PRIu64" buckets per table, mode %u, options",
+            argv[1], tr.cnt, tr.hdr.hash_seed, tr.hdr.index_size, tr.hdr.mode);
+     print_features(tr.hdr.features, tr.hdr.front_bits);
+     printf("\n  recorded   %.3f s, %.2f Mops/s\n  ops       ",
+            recorded_ns * 1e-9, tr.cnt / (recorded_ns * 1e-9 + 1e-12) / 1e6);
+     for (a = 1; a < REPLAY_OPS; a++) {
+          printf(" %s %"PRIu64, op_names[a], ops[a]);
+     }
+     if (ops[0]) {
+          printf(" unknown %"PRIu64, ops[0]);
+     }
+     printf("\n");
+
+     double rate = replay_throughput(&tr, &o, diverge, &first, &drops);
+     if ((rate < 0) || !replay_latency(&tr, &o, hist, &overhead, &max)) {
+          fprintf(stderr, "unable to allocate replay table\n");
+          free(tr.recs);
+          return -1;
+     }
+
+     printf("replay: mode %u, options", (o.plain ? 0 : tr.hdr.mode) | o.mode);
+     print_features((o.plain ? 0 : tr.hdr.features) | o.features,
+                    o.front_bits ? o.front_bits : tr.hdr.front_bits);
+     if (o.records) {
+          printf(", sized for %"PRIu64" records", o.records);
+     }
+     if (o.seed_set) {
+          printf(", seed 0x%08x", o.seed);
+     }
+     printf("\n  throughput %7.2f Mops/s (best of %d)  drops %"PRIu64"\n",
+            rate / 1e6, o.runs, drops);
+     printf("  divergence %"PRIu64" of %"PRIu64, diverge[0], tr.cnt);
+     if (diverge[0]) {
+          printf(" (");
+          for (a = 1; a < REPLAY_OPS; a++) {
+               printf("%s%s %"PRIu64, (a > 1) ? ", " : "", op_names[a], diverge[a]);
+          }
+          printf("), first at op %"PRIu64, first);
+     }
+     printf("\n  latency ns p50 %"PRIu64"  p90 %"PRIu64"  p99 %"PRIu64"  p99.9 %"PRIu64
+            "  max %"PRIu64"  (clock overhead %"PRIu64" taken off)\n",
+            lat_percentile(hist, tr.cnt, 50), lat_percentile(hist, tr.cnt, 90),
+            lat_percentile(hist, tr.cnt, 99), lat_percentile(hist, tr.cnt, 99.9),
+            max, overhead);
+
+     //one line per power of two
+     uint64_t below = 0;
+     uint32_t b = 0;
+     while (b < LAT_BUCKETS) {
+          uint32_t end = (b < LAT_SUB) ? LAT_SUB : b + LAT_SUB;
+          uint64_t cnt = 0;
+          uint64_t lo = (b < LAT_SUB) ? 0 : lat_upper(b - 1);
+          for (; b < end; b++) {
+               cnt += hist[b];
+          }
+          if (cnt) {
+               below += cnt;
+               printf("    %8"PRIu64" - %-8"PRIu64" %10"PRIu64"  %6.2f%%  %6.2f%%\n",
+                      lo, lat_upper(end - 1), cnt, cnt * 100.0 / tr.cnt,
+                      below * 100.0 / tr.cnt);
+          }
+     }
+
+     free(tr.recs);
+     return 0;
+}
@@ -0,0 +1,187 @@
+//node Transform stream that dedups framed records straight from Buffers
+// each chunk is copied into wasm memory once and handed to
+// stringhash9a_set_framed, with no string made per record.  a record cut
+// off at the end of a chunk stays at the front of the ring and is completed
+// by the next chunk.
+// usage (node):
+//   const Stringhash9Stream = require('./sh9stream.js')
+//   var dedup = new Stringhash9Stream(Module, sh);                //newline framing
+//   var dedup = new Stringhash9Stream(Module, sh, {framing: 'length'}); //uint32le length prefix
+//   var dedup = new Stringhash9Stream(Module, sh, {output: 'bitmap'});  //one byte per record, 1 == seen
+//   pipeline(fs.createReadStream('log'), dedup, process.stdout, done);
+// the stream is also an async iterator: for await (const buf of dedup) ...
+
+const { Transform } = require('stream');
+
+const FRAME_NEWLINE = 0;
+const FRAME_LEN32 = 1;
+const FRAME_FINAL = 0x100;
+
+const RINGBYTES = 1 << 20;
+const MAXRECS = 1 << 15;
+const MAXRECORD = 1 << 26;   //longest record buffered.. a length prefix past
+                             // this is refused as corrupt input once read
+
+class Stringhash9Stream extends Transform {
+ constructor(Module, sh, options) {
+   options = options || {};
+   super({ highWaterMark: options.highWaterMark });
+   if (typeof Module._stringhash9a_set_framed !== 'function') {
+     throw new Error("rebuild required: sh9.js was built without _stringhash9a_set_framed" +
+                     " - rebuild sh9.js/sh9.wasm with the emcc command under Modifications in README.md");
+   }
+   this.Module = Module;
+   this.sh = sh;
+   this.framing = (options.framing === 'length') ? FRAME_LEN32 : FRAME_NEWLINE;
+   this.bitmap = (options.output === 'bitmap');
+   this.maxrecord = options.maxRecordBytes || MAXRECORD;
+   this.offsPtr = Module._malloc(MAXRECS * 4);
+   this.lensPtr = Module._malloc(MAXRECS * 4);
+   this.resultsPtr = Module._malloc(MAXRECS);
+   this.consumedPtr = Module._malloc(4);
+   this.ringPtr = 0;
+   this.ringbytes = 0;
+   this.carry = 0;   //bytes of an unfinished record at the front of the ring
+   this.reserve(options.ringBytes || RINGBYTES);
+ }
+
+ //make sure the ring holds at least bytes, keeping the carried record
+ reserve(bytes) {
+   if (bytes <= this.ringbytes) {
+     return;
+   }
+   var Module = this.Module;
+   var size = Math.max(bytes, this.ringbytes * 2);
+   var ptr = Module._malloc(size);
+   if (!ptr) {
+     throw new Error("sh9stream: unable to allocate " + size + " bytes");
+   }
+   if (this.carry) {
+     Module.HEAPU8.copyWithin(ptr, this.ringPtr, this.ringPtr + this.carry);
+   }
+   if (this.ringPtr) {
+     Module._free(this.ringPtr);
+   }
+   this.ringPtr = ptr;
+   this.ringbytes = size;
+ }
+
+ //run every complete record in the first len bytes of the ring through
+ // the table and push the output for them
+ process(len, final) {
+   var Module = this.Module;
+   var pos = 0;
+   var n;
+   do {
+     n = Module._stringhash9a_set_framed(this.sh, this.ringPtr + pos, len - pos,
+                                         this.framing | final, this.offsPtr,
+                                         this.lensPtr, this.resultsPtr, MAXRECS,
+                                         this.consumedPtr);
+     if (n) {
+       this.pushRecords(this.ringPtr + pos, n);
+     }
+     pos += Module.HEAPU32[this.consumedPtr >> 2];
+   } while (n == MAXRECS && pos < len);
+
+   //slide the unfinished record to the front for the next chunk
+   Module.HEAPU8.copyWithin(this.ringPtr, this.ringPtr + pos, this.ringPtr + len);
+   this.carry = len - pos;
+ }
+
+ //length of the unfinished length framed record at the front of the ring,
+ // or 0 if its prefix has not all arrived yet (or framing is by newline)
+ carryPrefix() {
+   if (this.framing != FRAME_LEN32 || this.carry < 4) {
+     return 0;
+   }
+   var heap = this.Module.HEAPU8;
+   var p = this.ringPtr;
+   return (heap[p] | (heap[p + 1] << 8) | (heap[p + 2] << 16) | (heap[p + 3] << 24)) >>> 0;
+ }
+
+ //one output Buffer per call - either the results bitmap or the first-seen
+ // records with their framing, copied out of wasm memory in one pass
+ pushRecords(base, n) {
+   var Module = this.Module;
+   var heap = Buffer.from(Module.HEAPU8.buffer);
+   if (this.bitmap) {
+     this.push(Buffer.from(heap.subarray(this.resultsPtr, this.resultsPtr + n)));
+     return;
+   }
+   var offs = Module.HEAPU32.subarray(this.offsPtr >> 2, (this.offsPtr >> 2) + n);
+   var lens = Module.HEAPU32.subarray(this.lensPtr >> 2, (this.lensPtr >> 2) + n);
+   var results = Module.HEAPU8.subarray(this.resultsPtr, this.resultsPtr + n);
+   var frame = (this.framing == FRAME_LEN32) ? 4 : 1;
+   var total = 0;
+   var i;
+   for (i = 0; i < n; i++) {
+     total += results[i] ? 0 : lens[i] + frame;
+   }
+   if (!total) {
+     return;
+   }
+   var out = Buffer.allocUnsafe(total);
+   var w = 0;
+   for (i = 0; i < n; i++) {
+     if (results[i]) {
+       continue;
+     }
+     if (this.framing == FRAME_LEN32) {
+       w += heap.copy(out, w, base + offs[i] - 4, base + offs[i] + lens[i]);
+     }
+     else {
+       w += heap.copy(out, w, base + offs[i], base + offs[i] + lens[i]);
+       out[w++] = 10;   //the last record of a stream may not have had one
+     }
+   }
+   this.push(out);
+ }
+
+ _transform(chunk, encoding, callback) {
+   if (typeof chunk === 'string') {
+     chunk = Buffer.from(chunk, encoding);
+   }
+   var len = this.carry + chunk.length;
+   if (this.carry > this.maxrecord) {
+     return callback(new Error("sh9stream: record longer than " + this.maxrecord + " bytes"));
+   }
+   try {
+     this.reserve(len);
+   } catch (err) {
+     return callback(err);
+   }
+   this.Module.HEAPU8.set(chunk, this.ringPtr + this.carry);
+   this.process(len, 0);
+   var prefix = this.carryPrefix();
+   if (prefix > this.maxrecord) {
+     return callback(new Error("sh9stream: record length prefix " + prefix +
+                               " past " + this.maxrecord + " bytes"));
+   }
+   callback();
+ }
+
+ _flush(callback) {
+   if (this.carry) {
+     if (this.framing == FRAME_LEN32) {
+       return callback(new Error("sh9stream: stream ended inside a record"));
+     }
+     this.process(this.carry, FRAME_FINAL);
+   }
+   callback();
+ }
+
+ _destroy(err, callback) {
+   var Module = this.Module;
+   Module._free(this.ringPtr);
+   Module._free(this.offsPtr);
+   Module._free(this.lensPtr);
+   Module._free(this.resultsPtr);
+   Module._free(this.consumedPtr);
+   this.ringPtr = 0;
+   callback(err);
+ }
+}
+
+if (typeof module !== 'undefined') {
+ module.exports = Stringhash9Stream;
+}
@@ -0,0 +1,835 @@
+/*
+   regression checks for stringhash9a.. build with:
+   gcc -O2 -DSH9A_NO_MAIN sh9test.c stringhash9a.c -o sh9test
+
+   ./sh9test [name]    - runs every check when no name is given, exits
+                         non-zero if any of them fail
+*/
+
+/*
+No copyright is claimed in the United States under Title 17, U.S. Code.
+All Other Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include "stringhash9a.h"
+
+#define TEST_SEED 0x5eed9a
+
+//library internal, not in the header
+sh9a_index_t sh9a_alt_index(stringhash9a_t *, sh9a_index_t, uint32_t);
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { \
+     if (!(cond)) { \
+          printf("  FAIL %s:%d: ", __FILE__, __LINE__); \
+          printf(__VA_ARGS__); \
+          printf("\n"); \
+          failures++; \
+     } \
+} while (0)
+
+//lazy flush: a finished flush_step sweep leaves every tag at the current
+// generation.  if the next flush wraps the 8 bit generation, those tags must
+// not come back to life 256 flushes later, with no bucket touched between.
+// the stash, which is reset only when the generation wraps, is on too
+static void test_flush_wrap(void) {
+     uint32_t flushes;
+     uint32_t key = 42;
+     for (flushes = 1; flushes <= 300; flushes += (flushes < 250) ? 50 : 1) {
+          stringhash9a_t * sht = stringhash9a_create_seed(10000, TEST_SEED);
+          if (!sht || !stringhash9a_enable_lazy_flush(sht) ||
+              !stringhash9a_enable_stash(sht)) {
+               CHECK(0, "unable to allocate");
+               return;
+          }
+          while (sht->generation != 255) {
+               stringhash9a_flush(sht);
+          }
+          stringhash9a_set(sht, &key, 4);
+          while (!stringhash9a_flush_step(sht, 1 << 20)) {
+          }
+          uint32_t i;
+          for (i = 0; i < flushes; i++) {
+               stringhash9a_flush(sht);
+          }
+          CHECK(!stringhash9a_check(sht, &key, 4),
+                "key seen after a sweep and %u flushes", flushes);
+          stringhash9a_destroy(sht);
+     }
+}
+
+//the front cache must not answer for a key the table has since dropped..
+// a front table and a plain one fed the same keys have to agree, including
+// after the 8 bit epoch has wrapped
+static void test_front_evict(void) {
+     uint32_t n;
+     uint32_t hot = 0xFFFFFFFFU;
+     uint32_t wrong = 0;
+     for (n = 20000; n <= 100000; n += 500) {
+          stringhash9a_t * plain = stringhash9a_create_seed(20000, TEST_SEED);
+          stringhash9a_t * front = stringhash9a_create_seed(20000, TEST_SEED);
+          if (!plain || !front || !stringhash9a_enable_front(front, 20)) {
+               CHECK(0, "unable to allocate");
+               return;
+          }
+          stringhash9a_set(plain, &hot, 4);
+          stringhash9a_set(front, &hot, 4);
+          stringhash9a_check(front, &hot, 4);
+          uint32_t i;
+          for (i = 0; i < n; i++) {
+               stringhash9a_set(plain, &i, 4);
+               stringhash9a_set(front, &i, 4);
+          }
+          if (stringhash9a_check(front, &hot, 4) != stringhash9a_check(plain, &hot, 4)) {
+               wrong++;
+          }
+          stringhash9a_destroy(plain);
+          stringhash9a_destroy(front);
+     }
+     CHECK(!wrong, "front and plain tables disagree in %u runs", wrong);
+}
+
+//a key that has left the table must not be answered from the front cache,
+// even right away.  a one bucket pair table with a stash is filled, a hot
+// key is set and pushed on into the stash by n1 more keys, then found
+// there, and n2 more keys may push it out of the stash too.  a front table
+// and a plain one fed the same keys have to agree on it, in plain, verify
+// and cuckoo tables
+static void test_front_stale(void) {
+     uint32_t variant, n1, n2, i;
+     uint32_t hot = 0xFFFFFFFFU;
+     uint32_t wrong = 0;
+     uint32_t cached = 0;
+     for (variant = 0; variant < 3; variant++) {
+          for (n1 = 1; n1 < 128; n1++) {
+               for (n2 = 0; n2 < 32; n2++) {
+                    stringhash9a_t * plain = stringhash9a_create_seed(42, TEST_SEED);
+                    stringhash9a_t * front = stringhash9a_create_seed(42, TEST_SEED);
+                    if (!plain || !front || !stringhash9a_enable_front(front, 6) ||
+                        !stringhash9a_enable_stash(plain) ||
+                        !stringhash9a_enable_stash(front) ||
+                        ((variant == 1) && (!stringhash9a_enable_verify(plain) ||
+                                            !stringhash9a_enable_verify(front)))) {
+                         CHECK(0, "unable to allocate");
+                         return;
+                    }
+                    if (variant == 2) {
+                         plain->mode = SH9A_MODE_CUCKOO;
+                         front->mode = SH9A_MODE_CUCKOO;
+                    }
+                    for (i = 0; i < 100 + n1; i++) {
+                         if (i == 100) {
+                              stringhash9a_set(plain, &hot, 4);
+                              stringhash9a_set(front, &hot, 4);
+                         }
+                         stringhash9a_set(plain, &i, 4);
+                         stringhash9a_set(front, &i, 4);
+                    }
+                    int in_plain = stringhash9a_check(plain, &hot, 4);
+                    int in_front = stringhash9a_check(front, &hot, 4);
+                    if (in_plain != in_front) {
+                         wrong++;
+                    }
+                    cached += in_plain;
+                    for (; i < 100 + n1 + n2; i++) {
+                         stringhash9a_set(plain, &i, 4);
+                         stringhash9a_set(front, &i, 4);
+                    }
+                    if (stringhash9a_check(front, &hot, 4) !=
+                        stringhash9a_check(plain, &hot, 4)) {
+                         wrong++;
+                    }
+                    stringhash9a_destroy(plain);
+                    stringhash9a_destroy(front);
+               }
+          }
+     }
+     CHECK(cached, "hot key never found, nothing was cached");
+     CHECK(!wrong, "front and plain tables disagree %u times", wrong);
+}
+
+//check_get_age reads like a plain check and leaves the bucket's epoch
+// alone.. so does set_get_age, which also reports -1 for a key it had to
+// insert.  a touched key moves to the front, and whatever was ahead of it
+// reads SH9A_AGE_POS_EPOCHS older
+static void test_age(void) {
+     int verify;
+     for (verify = 0; verify < 2; verify++) {
+          stringhash9a_t * sht = stringhash9a_create_seed(10000, TEST_SEED);
+          if (!sht || (verify && !stringhash9a_enable_verify(sht))) {
+               CHECK(0, "unable to allocate");
+               return;
+          }
+          uint32_t key = 7;
+          uint32_t other = 8;
+          stringhash9a_set(sht, &key, 4);
+          sht->epoch += 5;
+          CHECK(stringhash9a_check_get_age(sht, &key, 4) == 5,
+                "check_get_age of an old key (verify %d)", verify);
+          CHECK(stringhash9a_check_get_age(sht, &key, 4) == 5,
+                "check_get_age does not restamp (verify %d)", verify);
+          CHECK(stringhash9a_set_get_age(sht, &key, 4) == 5,
+                "set_get_age of an old key (verify %d)", verify);
+          CHECK(stringhash9a_check_get_age(sht, &key, 4) == 5,
+                "set_get_age does not restamp (verify %d)", verify);
+          CHECK(stringhash9a_check_get_age(sht, &other, 4) == -1,
+                "check_get_age of a missing key (verify %d)", verify);
+          CHECK(stringhash9a_set_get_age(sht, &other, 4) == -1,
+                "set_get_age of a new key (verify %d)", verify);
+          CHECK(stringhash9a_check_get_age(sht, &other, 4) == 0,
+                "set_get_age inserts a new key (verify %d)", verify);
+          stringhash9a_destroy(sht);
+     }
+
+     //one bucket per half: a and c tie into the first bucket, b (set
+     // between them) goes to the emptier second one
+     stringhash9a_t * sht = stringhash9a_create_records(42);
+     uint32_t a = 1, b = 2, c = 3;
+     if (!sht || (sht->index_size != 1)) {
+          CHECK(0, "unable to allocate");
+          return;
+     }
+     stringhash9a_set(sht, &a, 4);
+     stringhash9a_set(sht, &b, 4);
+     stringhash9a_set(sht, &c, 4);
+     sht->epoch += 5;
+     uint32_t stamp = sht->buckets[0].digest[15] & SH9A_LEFTOVER_MASK;
+     CHECK(stringhash9a_check_get_age(sht, &c, 4) == 5, "newest entry age");
+     CHECK(stringhash9a_check_get_age(sht, &a, 4) == 5 + SH9A_AGE_POS_EPOCHS,
+           "entry behind it");
+     CHECK(stringhash9a_check_get_age(sht, &c, 4) == 5 + SH9A_AGE_POS_EPOCHS,
+           "neighbour moved back by a check_get_age touch");
+     CHECK(stringhash9a_set_get_age(sht, &a, 4) == 5 + SH9A_AGE_POS_EPOCHS,
+           "set_get_age of the entry behind");
+     CHECK(stringhash9a_check_get_age(sht, &c, 4) == 5 + SH9A_AGE_POS_EPOCHS,
+           "neighbour moved back by a set_get_age touch");
+     CHECK((sht->buckets[0].digest[15] & SH9A_LEFTOVER_MASK) == stamp,
+           "bucket epoch unchanged by age lookups");
+     stringhash9a_destroy(sht);
+}
+
+//window and group sets feed the cardinality sidecar of the table they set
+// into, the same as a plain set does
+static void test_hll_paths(void) {
+     uint32_t n = 20000;
+     uint32_t i;
+     stringhash9a_window_t * shw = stringhash9a_window_create(n);
+     stringhash9a_group_t * shg = stringhash9a_group_create();
+     if (!shw || !shg || !stringhash9a_enable_hll(shw->cur, 12) ||
+         (stringhash9a_group_add(shg, n) != 0) ||
+         (stringhash9a_group_add(shg, n) != 1) ||
+         !stringhash9a_enable_hll(shg->tables[0], 12) ||
+         !stringhash9a_enable_hll(shg->tables[1], 12)) {
+          CHECK(0, "unable to allocate");
+          return;
+     }
+     for (i = 0; i < n; i++) {
+          stringhash9a_window_set(shw, &i, 4);
+          stringhash9a_group_set(shg, &i, 4, 1);
+     }
+     double est = stringhash9a_hll_estimate(shw->cur);
+     CHECK((est > n * 0.9) && (est < n * 1.1), "window estimate %.0f of %u", est, n);
+     est = stringhash9a_hll_estimate(shg->tables[0]);
+     CHECK((est > n * 0.9) && (est < n * 1.1), "group estimate %.0f of %u", est, n);
+     est = stringhash9a_hll_estimate(shg->tables[1]);
+     CHECK(est < 1.0, "unselected group member estimate %.0f", est);
+     stringhash9a_window_destroy(shw);
+     stringhash9a_group_destroy(shg);
+}
+
+//a window answers for keys set in the current or previous generation.. one
+// rotation keeps everything, a second drops what was not set again in
+// between
+static void test_window(void) {
+     uint32_t n = 20000;
+     uint32_t i, missing = 0, stale = 0, kept = 0;
+     stringhash9a_window_t * shw = stringhash9a_window_create(100000);
+     if (!shw) {
+          CHECK(0, "unable to allocate");
+          return;
+     }
+     for (i = 0; i < n; i++) {
+          stringhash9a_window_set(shw, &i, 4);
+     }
+     stringhash9a_window_rotate(shw);
+     for (i = 0; i < n; i++) {
+          missing += !stringhash9a_window_check(shw, &i, 4);
+     }
+     CHECK(!missing, "%u of %u keys lost after one rotation", missing, n);
+     for (i = 0; i < n / 2; i++) {
+          kept += stringhash9a_window_set(shw, &i, 4);
+     }
+     CHECK(kept == n / 2, "set found %u of %u keys from the previous window",
+           kept, n / 2);
+     stringhash9a_window_rotate(shw);
+     missing = 0;
+     for (i = 0; i < n; i++) {
+          int found = stringhash9a_window_check(shw, &i, 4);
+          if (i < n / 2) {
+               missing += !found;
+          }
+          else {
+               stale += found;
+          }
+     }
+     CHECK(!missing, "%u of %u keys set again lost after rotation", missing, n / 2);
+     CHECK(stale <= n / 1000, "%u keys outlived two rotations", stale);
+     stringhash9a_window_rotate(shw);
+     stale = 0;
+     for (i = 0; i < n; i++) {
+          stale += stringhash9a_window_check(shw, &i, 4);
+     }
+     CHECK(stale <= n / 1000, "%u keys outlived three rotations", stale);
+     stringhash9a_window_destroy(shw);
+}
+
+//a group hashes a key once for all its members.. each member has to answer
+// for exactly the keys set in it, and agree with a plain check on the member
+// table, which hashes the key itself
+static void test_group(void) {
+     static const size_t sizes[] = {10000, 50000, 200000};
+     uint32_t n = 5000;
+     uint32_t i, j, wrong = 0, disagree = 0;
+     stringhash9a_group_t * shg = stringhash9a_group_create();
+     if (!shg) {
+          CHECK(0, "unable to allocate");
+          return;
+     }
+     for (j = 0; j < 3; j++) {
+          if (stringhash9a_group_add(shg, sizes[j]) != (int)j) {
+               CHECK(0, "unable to add member %u", j);
+               stringhash9a_group_destroy(shg);
+               return;
+          }
+     }
+     for (i = 0; i < n; i++) {
+          uint64_t members = (1ULL << (i % 3)) | ((i & 1) ? 4 : 0);
+          stringhash9a_group_set(shg, &i, 4, members);
+     }
+     for (i = 0; i < n; i++) {
+          uint64_t members = (1ULL << (i % 3)) | ((i & 1) ? 4 : 0);
+          uint64_t found = stringhash9a_group_check(shg, &i, 4, ~0ULL);
+          wrong += (found != members);
+          for (j = 0; j < 3; j++) {
+               disagree += (stringhash9a_check(shg->tables[j], &i, 4) !=
+                            (int)((found >> j) & 1));
+          }
+     }
+     CHECK(wrong <= n / 1000, "%u of %u keys found in the wrong members", wrong, n);
+     CHECK(!disagree, "group and member checks disagree %u times", disagree);
+     stringhash9a_group_destroy(shg);
+}
+
+//create_records sizes the table to the bucket, not the next power of two..
+// index_size has to be the record count over 42 rounded up, and range
+// reduction has to reach every bucket of both tables
+static void test_create_records(void) {
+     static const size_t counts[] = {1, 42, 43, 1000, 4200, 99999, 1000003};
+     uint32_t j;
+     for (j = 0; j < sizeof(counts)/sizeof(counts[0]); j++) {
+          stringhash9a_t * sht = stringhash9a_create_records(counts[j]);
+          if (!sht) {
+               CHECK(0, "unable to allocate %zu records", counts[j]);
+               continue;
+          }
+          uint64_t want = (counts[j] + 41) / 42;
+          CHECK(sht->index_size == want, "%zu records gave %" PRIu64
+                " buckets per table, not %" PRIu64, counts[j], sht->index_size, want);
+          CHECK(sht->max_records >= counts[j], "%zu records gave room for %" PRIu64,
+                counts[j], sht->max_records);
+          //half full is about 10 entries a bucket, so none should be empty
+          uint32_t n = (uint32_t)(sht->max_records / 2);
+          uint32_t i, missing = 0;
+          uint64_t b, empty = 0;
+          for (i = 0; i < n; i++) {
+               stringhash9a_set(sht, &i, 4);
+          }
+          for (i = 0; i < n; i++) {
+               missing += !stringhash9a_check(sht, &i, 4);
+          }
+          for (b = 0; b < sht->index_size * 2; b++) {
+               empty += !sht->buckets[b].digest[0];
+          }
+          CHECK(!missing, "%u of %u keys lost in a %zu record table",
+                missing, n, counts[j]);
+          CHECK(!empty, "%" PRIu64 " of %" PRIu64 " buckets never used in a %zu"
+                " record table", empty, sht->index_size * 2, counts[j]);
+          stringhash9a_destroy(sht);
+     }
+}
+
+//a key split over several buffers has to hash exactly like the same bytes
+// in one piece, wherever the splits fall, empty pieces included
+static void test_segments(void) {
+     uint8_t key[100];
+     uint32_t len, a, b, wrong = 0;
+     stringhash9a_t * sht = stringhash9a_create_seed(100000, TEST_SEED);
+     if (!sht) {
+          CHECK(0, "unable to allocate");
+          return;
+     }
+     for (len = 0; len < sizeof(key); len++) {
+          key[len] = (uint8_t)(len * 37 + 11);
+     }
+     for (len = 1; len <= sizeof(key); len += 3) {
+          for (a = 0; a <= len; a += 5) {
+               for (b = a; b <= len; b += 7) {
+                    sh9a_segment_t seg[3] = {
+                         {key, a}, {key + a, b - a}, {key + b, len - b},
+                    };
+                    //flip a byte so every split point tests a fresh key
+                    key[0] ^= (uint8_t)(a + b);
+                    stringhash9a_set_segments(sht, seg, 3);
+                    wrong += !stringhash9a_check(sht, key, (int)len);
+                    stringhash9a_set(sht, key + 1, (int)len - 1);
+                    seg[0].key = key + 1;
+                    seg[0].keylen = a ? a - 1 : 0;
+                    if (a) {
+                         wrong += !stringhash9a_check_segments(sht, seg, 3);
+                    }
+                    key[0] ^= (uint8_t)(a + b);
+               }
+          }
+     }
+     CHECK(!wrong, "segmented and one piece hashes differ %u times", wrong);
+     stringhash9a_destroy(sht);
+}
+
+//a table filled to its nominal size drops some keys from full bucket pairs..
+// with the stash on, fewer are lost, and nothing found in the plain table
+// is lost
+static void test_stash(void) {
+     stringhash9a_t * plain = stringhash9a_create_seed(100000, TEST_SEED);
+     stringhash9a_t * stash = stringhash9a_create_seed(100000, TEST_SEED);
+     if (!plain || !stash || !stringhash9a_enable_stash(stash)) {
+          CHECK(0, "unable to allocate");
+          return;
+     }
+     uint32_t n = (uint32_t)plain->max_records;
+     uint32_t i, lost_plain = 0, lost_stash = 0, lost_both = 0;
+     for (i = 0; i < n; i++) {
+          stringhash9a_set(plain, &i, 4);
+          stringhash9a_set(stash, &i, 4);
+     }
+     for (i = 0; i < n; i++) {
+          int in_plain = stringhash9a_check(plain, &i, 4);
+          int in_stash = stringhash9a_check(stash, &i, 4);
+          lost_plain += !in_plain;
+          lost_stash += !in_stash;
+          lost_both += in_plain && !in_stash;
+     }
+     CHECK(lost_plain, "a full table lost no keys, the test needs a fuller one");
+     CHECK(lost_stash < lost_plain, "stash table lost %u keys, plain %u",
+           lost_stash, lost_plain);
+     CHECK(!lost_both, "%u keys found in the plain table lost with the stash on",
+           lost_both);
+     stringhash9a_destroy(plain);
+     stringhash9a_destroy(stash);
+}
+
+//cuckoo mode: the alternate bucket of the alternate bucket is where an entry
+// started, on power of two and exact size tables alike, so kicked entries
+// stay findable.  deleted keys have to go, and the rest stay
+static void test_cuckoo(void) {
+     uint32_t t;
+     for (t = 0; t < 2; t++) {
+          stringhash9a_t * sht = t ? stringhash9a_create_records(100000) :
+               stringhash9a_create_seed(100000, TEST_SEED);
+          if (!sht) {
+               CHECK(0, "unable to allocate");
+               return;
+          }
+          sht->mode = SH9A_MODE_CUCKOO;
+          uint64_t buckets = sht->index_size * 2;
+          uint32_t i, bad = 0;
+          for (i = 0; i < 100000; i++) {
+               sh9a_index_t h = (sh9a_index_t)(((uint64_t)i * 2654435761U) % buckets);
+               uint32_t d = (i * 40503U + 1) << SH9A_DIGEST_SHIFT;
+               sh9a_index_t alt = sh9a_alt_index(sht, h, d);
+               bad += (alt >= buckets) || (sh9a_alt_index(sht, alt, d) != h);
+          }
+          CHECK(!bad, "alternate bucket mapping broken %u times (exact size %u)",
+                bad, t);
+
+          uint32_t n = (uint32_t)sht->max_records;
+          uint32_t missing = 0, kept = 0, stale = 0;
+          for (i = 0; i < n; i++) {
+               stringhash9a_set(sht, &i, 4);
+          }
+          CHECK(sht->kicks, "no entries were kicked in a full table");
+          for (i = 0; i < n; i++) {
+               missing += !stringhash9a_check(sht, &i, 4);
+          }
+          CHECK(missing <= sht->drops, "%u keys missing with %" PRIu64 " drops",
+                missing, sht->drops);
+          for (i = 0; i < n; i += 2) {
+               stringhash9a_delete(sht, &i, 4);
+          }
+          for (i = 0; i < n; i++) {
+               if (i & 1) {
+                    kept += stringhash9a_check(sht, &i, 4);
+               }
+               else {
+                    stale += stringhash9a_check(sht, &i, 4);
+               }
+          }
+          CHECK(kept + missing >= n / 2, "only %u of %u undeleted keys left",
+                kept, n / 2);
+          CHECK(stale <= n / 1000, "%u deleted keys still found", stale);
+          stringhash9a_destroy(sht);
+     }
+}
+
+//blocked mode keeps both buckets of a key in one block.. keys set in a half
+// full table are all found and keys never set are not, and a table too
+// small for a block falls back to plain placement
+static void test_blocked(void) {
+     stringhash9a_t * sht = stringhash9a_create_mode(42, SH9A_MODE_BLOCKED);
+     if (!sht) {
+          CHECK(0, "unable to allocate");
+          return;
+     }
+     CHECK(!(sht->mode & SH9A_MODE_BLOCKED), "blocked mode kept on a %" PRIu64
+           " bucket table", sht->index_size * 2);
+     stringhash9a_destroy(sht);
+
+     sht = stringhash9a_create_mode(200000, SH9A_MODE_BLOCKED);
+     if (!sht) {
+          CHECK(0, "unable to allocate");
+          return;
+     }
+     CHECK(sht->mode & SH9A_MODE_BLOCKED, "blocked mode turned off");
+     uint32_t n = (uint32_t)(sht->max_records / 2);
+     uint32_t i, missing = 0, false_pos = 0;
+     for (i = 0; i < n; i++) {
+          stringhash9a_set(sht, &i, 4);
+     }
+     for (i = 0; i < n; i++) {
+          uint32_t other = i + n;
+          missing += !stringhash9a_check(sht, &i, 4);
+          false_pos += stringhash9a_check(sht, &other, 4);
+     }
+     CHECK(!missing, "%u of %u keys lost in a half full blocked table", missing, n);
+     CHECK(false_pos <= n / 1000, "%u of %u keys never set were found",
+           false_pos, n);
+     stringhash9a_destroy(sht);
+}
+
+//verify mode confirms digest matches against the full key hash.. keys never
+// set are not found in a half full table, where a plain one finds some, and
+// keys set are all found
+static void test_verify(void) {
+     stringhash9a_t * plain = stringhash9a_create_seed(500000, TEST_SEED);
+     stringhash9a_t * verify = stringhash9a_create_seed(500000, TEST_SEED);
+     if (!plain || !verify || !stringhash9a_enable_verify(verify)) {
+          CHECK(0, "unable to allocate");
+          return;
+     }
+     uint32_t n = (uint32_t)(plain->max_records / 2);
+     uint32_t i, fp_plain = 0, fp_verify = 0, missing = 0;
+     for (i = 0; i < n; i++) {
+          stringhash9a_set(plain, &i, 4);
+          stringhash9a_set(verify, &i, 4);
+     }
+     for (i = n; i < 9 * n; i++) {
+          fp_plain += stringhash9a_check(plain, &i, 4);
+          fp_verify += stringhash9a_check(verify, &i, 4);
+     }
+     for (i = 0; i < n; i++) {
+          missing += !stringhash9a_check(verify, &i, 4);
+     }
+     CHECK(fp_plain, "no false positives in the plain table, the test needs more keys");
+     CHECK(!fp_verify, "%u false positives in verify mode (plain %u)",
+           fp_verify, fp_plain);
+     CHECK(verify->verify_rejects >= fp_plain, "%" PRIu64 " digest matches"
+           " rejected, plain table found %u", verify->verify_rejects, fp_plain);
+     CHECK(!missing, "%u of %u keys lost in verify mode", missing, n);
+     stringhash9a_destroy(plain);
+     stringhash9a_destroy(verify);
+}
+
+//tables past 4G buckets take bucket numbers from a 128 bit product.. on a
+// table header with no buckets behind it, cuckoo alternates must stay in
+// range, map back, and reach the buckets past 2^32 as often as the rest
+static void test_index64(void) {
+#ifdef SH9A_INDEX64
+     stringhash9a_t wide;
+     memset(&wide, 0, sizeof(wide));
+     wide.index_size = (3ULL << 32) + 5;
+     uint64_t buckets = wide.index_size * 2;
+     uint32_t i, bad = 0, high = 0, n = 100000;
+     for (i = 0; i < n; i++) {
+          sh9a_index_t h = (sh9a_index_t)(((uint64_t)i * 0x9E3779B97F4A7C15ULL) % buckets);
+          uint32_t d = (i * 40503U + 1) << SH9A_DIGEST_SHIFT;
+          sh9a_index_t alt = sh9a_alt_index(&wide, h, d);
+          bad += (alt >= buckets) || (sh9a_alt_index(&wide, alt, d) != h);
+          //from bucket 0 the alternate is the digest's own bucket number
+          high += (sh9a_alt_index(&wide, 0, d) >> 32) != 0;
+     }
+     CHECK(!bad, "alternate bucket out of range or not reversible %u times", bad);
+     //all but 1 in 6 of the buckets are past 2^32
+     CHECK((high > n * 0.8) && (high < n * 0.87), "%u of %u alternates past 2^32",
+           high, n);
+#endif
+}
+
+//set_framed on a stream cut into chunks, with the unconsumed tail of each
+// call carried over to the next.. records that span chunk boundaries have
+// to come out whole and in order, once each, for both framings, the last
+// newline record without its newline
+#define TEST_FRAMED_RECS 200
+static void test_framed(void) {
+     static const uint32_t chunks[] = {1, 3, 7, 64, 100000};
+     static uint8_t stream[TEST_FRAMED_RECS * 32];
+     static uint8_t pend[TEST_FRAMED_RECS * 32];
+     char keys[TEST_FRAMED_RECS][32];
+     uint32_t klen[TEST_FRAMED_RECS];
+     uint32_t offs[8], lens[8];
+     uint8_t results[8];
+     uint32_t framing, c, i;
+
+     for (i = 0; i < TEST_FRAMED_RECS; i++) {
+          klen[i] = (uint32_t)snprintf(keys[i], sizeof(keys[i]), "key-%u-%.*s",
+                                       i, (int)(i % 13), "xxxxxxxxxxxxx");
+     }
+     for (framing = SH9A_FRAME_NEWLINE; framing <= SH9A_FRAME_LEN32; framing++) {
+          uint32_t total = 0;
+          for (i = 0; i < TEST_FRAMED_RECS; i++) {
+               if (framing == SH9A_FRAME_LEN32) {
+                    stream[total++] = (uint8_t)klen[i];
+                    stream[total++] = 0;
+                    stream[total++] = 0;
+                    stream[total++] = 0;
+               }
+               memcpy(stream + total, keys[i], klen[i]);
+               total += klen[i];
+               if ((framing == SH9A_FRAME_NEWLINE) && (i + 1 < TEST_FRAMED_RECS)) {
+                    stream[total++] = '\n';
+               }
+          }
+          for (c = 0; c < sizeof(chunks)/sizeof(chunks[0]); c++) {
+               stringhash9a_t * sht = stringhash9a_create_seed(10000, TEST_SEED);
+               if (!sht) {
+                    CHECK(0, "unable to allocate");
+                    return;
+               }
+               uint32_t fed = 0, plen = 0, recs = 0, wrong = 0, dups = 0;
+               while (fed < total) {
+                    uint32_t step = (total - fed < chunks[c]) ? total - fed : chunks[c];
+                    memcpy(pend + plen, stream + fed, step);
+                    plen += step;
+                    fed += step;
+                    uint32_t flags = framing | ((fed == total) ? SH9A_FRAME_FINAL : 0);
+                    int n;
+                    do {
+                         uint32_t consumed;
+                         n = stringhash9a_set_framed(sht, pend, plen, flags, offs, lens,
+                                                     results, 8, &consumed);
+                         int j;
+                         for (j = 0; j < n; j++, recs++) {
+                              wrong += (recs >= TEST_FRAMED_RECS) ||
+                                   (lens[j] != klen[recs]) ||
+                                   memcmp(pend + offs[j], keys[recs], lens[j]);
+                              dups += results[j];
+                         }
+                         memmove(pend, pend + consumed, plen - consumed);
+                         plen -= consumed;
+                    } while (n > 0);
+               }
+               CHECK(recs == TEST_FRAMED_RECS, "%u of %u records (framing %u, chunk %u)",
+                     recs, TEST_FRAMED_RECS, framing, chunks[c]);
+               CHECK(!wrong && !dups && !plen, "%u records garbled, %u repeated, %u"
+                     " bytes left (framing %u, chunk %u)", wrong, dups, plen,
+                     framing, chunks[c]);
+               for (i = 0; i < TEST_FRAMED_RECS; i++) {
+                    wrong += !stringhash9a_check(sht, keys[i], (int)klen[i]);
+               }
+               CHECK(!wrong, "%u records not set (framing %u, chunk %u)", wrong,
+                     framing, chunks[c]);
+               stringhash9a_destroy(sht);
+          }
+     }
+}
+
+//the multi-lane kernel has to give every lane the scalar evahash64 of its
+// key, for every length through a few 12 byte rounds and tails, bytes with
+// the top bit set and keys at odd addresses
+static void test_lanes(void) {
+     static const uint32_t seeds[] = {0, TEST_SEED, 0xFFFFFFFFU};
+     uint8_t buf[EVAHASH64_LANES][128];
+     uint8_t * keys[EVAHASH64_LANES];
+     uint64_t out[EVAHASH64_LANES];
+     uint32_t s, len, wrong = 0;
+     int i, j;
+     for (i = 0; i < EVAHASH64_LANES; i++) {
+          for (j = 0; j < 128; j++) {
+               buf[i][j] = (uint8_t)((i + 1) * 131 + j * 197);
+          }
+          keys[i] = buf[i] + (i % 4);
+     }
+     for (s = 0; s < sizeof(seeds)/sizeof(seeds[0]); s++) {
+          for (len = 0; len <= 100; len++) {
+               evahash64_lanes(keys, len, seeds[s], out);
+               for (i = 0; i < EVAHASH64_LANES; i++) {
+                    wrong += (out[i] != evahash64(keys[i], len, seeds[s]));
+               }
+          }
+     }
+     CHECK(!wrong, "%u lane hashes differ from scalar evahash64", wrong);
+}
+
+//a recorded trace replayed on a table rebuilt from its header has to give
+// back every recorded result.. the table has every option on, runs past
+// full and is flushed halfway.  needs a -DSH9A_TRACE build, others only
+// check that recording is refused
+static void test_trace(void) {
+     const char * path = "sh9test.sh9t";
+     stringhash9a_t * sht = stringhash9a_create_seed(20000, TEST_SEED);
+     if (!sht) {
+          CHECK(0, "unable to allocate");
+          return;
+     }
+#ifndef SH9A_TRACE
+     CHECK(!stringhash9a_trace_open(sht, path), "trace opened without SH9A_TRACE");
+     stringhash9a_destroy(sht);
+#else
+     if (!stringhash9a_enable_stash(sht) || !stringhash9a_enable_verify(sht) ||
+         !stringhash9a_enable_lazy_flush(sht) || !stringhash9a_enable_hll(sht, 10) ||
+         !stringhash9a_enable_front(sht, 10) || !stringhash9a_trace_open(sht, path)) {
+          CHECK(0, "unable to allocate or open %s", path);
+          stringhash9a_destroy(sht);
+          return;
+     }
+     uint32_t n = (uint32_t)sht->max_records * 2;
+     uint32_t i, ops = 0;
+     for (i = 0; i < n; i++) {
+          uint32_t key = i % 5 ? i : i / 5;
+          stringhash9a_set(sht, &key, 4);
+          key = i / 3;
+          switch (i % 4) {
+          case 0: stringhash9a_check(sht, &key, 4); break;
+          case 1: stringhash9a_check_get_age(sht, &key, 4); break;
+          case 2: stringhash9a_set_get_age(sht, &key, 4); break;
+          case 3: stringhash9a_delete(sht, &key, 4); break;
+          }
+          ops += 2;
+          if (i == n / 2) {
+               stringhash9a_flush(sht);
+               ops++;
+          }
+     }
+     stringhash9a_destroy(sht);
+
+     FILE * fp = fopen(path, "rb");
+     sh9a_trace_header_t hdr;
+     sh9a_trace_rec_t rec;
+     if (!fp || (fread(&hdr, sizeof(hdr), 1, fp) != 1) ||
+         (hdr.magic != SH9A_TRACE_MAGIC) || (hdr.rec_size != sizeof(rec))) {
+          CHECK(0, "unable to read back %s", path);
+          if (fp) {
+               fclose(fp);
+          }
+          remove(path);
+          return;
+     }
+     sht = stringhash9a_create_records(hdr.index_size * 42);
+     if (!sht || !stringhash9a_enable_stash(sht) || !stringhash9a_enable_verify(sht) ||
+         !stringhash9a_enable_lazy_flush(sht) ||
+         !stringhash9a_enable_hll(sht, hdr.hll_bits) ||
+         !stringhash9a_enable_front(sht, hdr.front_bits)) {
+          CHECK(0, "unable to allocate");
+          fclose(fp);
+          remove(path);
+          return;
+     }
+     sht->hash_seed = hdr.hash_seed;
+     sht->mode = hdr.mode;
+     uint32_t recs = 0, diverged = 0;
+     while (fread(&rec, sizeof(rec), 1, fp) == 1) {
+          int result = 0;
+          switch (rec.op) {
+          case SH9A_TRACE_SET: result = stringhash9a_set_hash(sht, rec.hash); break;
+          case SH9A_TRACE_CHECK: result = stringhash9a_check_hash(sht, rec.hash); break;
+          case SH9A_TRACE_AGE: result = stringhash9a_check_get_age_hash(sht, rec.hash); break;
+          case SH9A_TRACE_DELETE: result = stringhash9a_delete_hash(sht, rec.hash); break;
+          case SH9A_TRACE_FLUSH: stringhash9a_flush(sht); break;
+          case SH9A_TRACE_SET_AGE: result = stringhash9a_set_get_age_hash(sht, rec.hash); break;
+          }
+          diverged += (result != rec.result);
+          recs++;
+     }
+     fclose(fp);
+     remove(path);
+     CHECK(recs == ops, "%u of %u calls recorded", recs, ops);
+     CHECK(sht->drops, "the replayed table never filled up");
+     CHECK(!diverged, "%u of %u replayed results differ from the recording",
+           diverged, recs);
+     stringhash9a_destroy(sht);
+#endif
+}
+
+typedef struct _sh9_test_t {
+     const char * name;
+     void (*run)(void);
+} sh9_test_t;
+
+static const sh9_test_t tests[] = {
+     {"flush_wrap", test_flush_wrap},
+     {"front_evict", test_front_evict},
+     {"front_stale", test_front_stale},
+     {"age", test_age},
+     {"hll_paths", test_hll_paths},
+     {"window", test_window},
+     {"group", test_group},
+     {"records", test_create_records},
+     {"segments", test_segments},
+     {"stash", test_stash},
+     {"cuckoo", test_cuckoo},
+     {"blocked", test_blocked},
+     {"verify", test_verify},
+     {"index64", test_index64},
+     {"framed", test_framed},
+     {"lanes", test_lanes},
+     {"trace", test_trace},
+};
+
+int main(int argc, char ** argv) {
+     uint32_t i;
+     int ran = 0;
+     for (i = 0; i < sizeof(tests)/sizeof(tests[0]); i++) {
+          if ((argc < 2) || !strcmp(argv[1], tests[i].name)) {
+               int before = failures;
+               tests[i].run();
+               printf("%-12s %s\n", tests[i].name, (failures == before) ? "ok" : "FAILED");
+               ran = 1;
+          }
+     }
+     if (!ran) {
+          fprintf(stderr, "unknown test %s\n", argv[1]);
+          return -1;
+     }
+     return failures ? 1 : 0;
+}
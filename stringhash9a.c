@@ -1,6 +1,12 @@
 /* 
    compile using:
-   emcc stringhash9a.c -o sh9.js -s ALLOW_MEMORY_GROWTH=1 -s EXPORTED_FUNCTIONS="['_stringhash9a_create','_stringhash9a_set', '_stringhash9a_check','_stringhash9a_destroy','_main','_malloc']" -s EXTRA_EXPORTED_RUNTIME_METHODS="['lengthBytesUTF8', 'stringToUTF8', 'writeArrayToMemory']" -O2
+   emcc stringhash9a.c -o sh9.js -s ALLOW_MEMORY_GROWTH=1 -s EXPORTED_FUNCTIONS="['_stringhash9a_create','_stringhash9a_set', '_stringhash9a_check','_stringhash9a_destroy','_stringhash9a_set_segments','_stringhash9a_check_segments','_stringhash9a_set_batch','_stringhash9a_check_batch','_stringhash9a_bulk_load','_stringhash9a_set_framed','_stringhash9a_set_get_age','_stringhash9a_check_get_age','_main','_malloc','_free']" -s EXTRA_EXPORTED_RUNTIME_METHODS="['lengthBytesUTF8', 'stringToUTF8', 'writeArrayToMemory']" -O2
+
+   or for the lean standalone module used by sh9.mjs (no main, no stdio):
+   emcc stringhash9a.c -o sh9lean.wasm -DSH9A_NO_MAIN -O3 --no-entry -s STANDALONE_WASM -s MALLOC=emmalloc -s FILESYSTEM=0 -s ALLOW_MEMORY_GROWTH=1 -s EXPORTED_FUNCTIONS="['_stringhash9a_create','_stringhash9a_set','_stringhash9a_check','_stringhash9a_delete','_stringhash9a_flush','_stringhash9a_destroy','_stringhash9a_set_segments','_stringhash9a_check_segments','_stringhash9a_set_batch','_stringhash9a_check_batch','_stringhash9a_bulk_load','_stringhash9a_set_framed','_stringhash9a_set_get_age','_stringhash9a_check_get_age','_malloc','_free']"
+
+   add -s MEMORY64=1 -s MAXIMUM_MEMORY=64GB (output sh9lean64.wasm) for tables past 4GB
+   add -msimd128 to hash short keys in set/check_batch and bulk load with wasm simd
 
 */
 
@@ -33,6 +39,70 @@ SOFTWARE.
 //#define DEBUG 1
 #include "stringhash9a.h"
 
+#if defined(__GNUC__)
+#define SH9A_PREFETCH(p) __builtin_prefetch(p)
+#else
+#define SH9A_PREFETCH(p)
+#endif
+
+#ifdef SH9A_TRACE
+#include <stdio.h>
+#include <time.h>
+
+#define SH9A_TRACE_BUF 4096 //records buffered per write
+
+struct _sh9a_trace_t {
+     FILE * fp;
+     uint64_t last_ns;
+     uint64_t cnt;
+     uint32_t used;
+     sh9a_trace_rec_t buf[SH9A_TRACE_BUF];
+};
+
+static uint64_t sh9a_trace_now(void) {
+     struct timespec ts;
+     clock_gettime(CLOCK_MONOTONIC, &ts);
+     return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void sh9a_trace_write(sh9a_trace_t * tr) {
+     if (tr->used &&
+         (fwrite(tr->buf, sizeof(sh9a_trace_rec_t), tr->used, tr->fp) != tr->used)) {
+          dprint("stringhash9a trace write failed");
+     }
+     tr->used = 0;
+}
+
+//append one call to the trace.. timestamps are kept as deltas so a record
+// stays at 16 bytes
+static void sh9a_trace_op(stringhash9a_t * sht, uint8_t op, uint64_t hash,
+                          int result) {
+     sh9a_trace_t * tr = sht->trace;
+     if (!tr) {
+          return;
+     }
+     uint64_t now = sh9a_trace_now();
+     uint64_t dt = now - tr->last_ns;
+     sh9a_trace_rec_t * rec = &tr->buf[tr->used++];
+     tr->last_ns = now;
+     tr->cnt++;
+     rec->hash = hash;
+     rec->dt = (dt > 0xFFFFFFFFU) ? 0xFFFFFFFFU : (uint32_t)dt;
+     rec->op = op;
+     rec->flags = 0;
+     rec->result = (int16_t)result;
+     if (tr->used == SH9A_TRACE_BUF) {
+          sh9a_trace_write(tr);
+     }
+}
+#define SH9A_TRACE_OP(sht, op, hash, result) sh9a_trace_op(sht, op, hash, result)
+#else
+#define SH9A_TRACE_OP(sht, op, hash, result)
+#endif
+
+#ifndef SH9A_NO_MAIN
+#include <stdio.h>
+
 int main () {
      stringhash9a_t * sht = stringhash9a_create(4 * 1000000);
      //stringhash9a_t * sht = stringhash9a_create(20000000);
@@ -40,7 +110,7 @@ int main () {
           printf("unable to allocate\n");
           return -1;
      }
-     printf("strh9 max records %u\n", sht->max_records);
+     printf("strh9 max records %"PRIu64"\n", sht->max_records);
      printf("strh9 mem used %"PRIu64"\n", sht->mem_used);
      printf("hash result %d\n", stringhash9a_set(sht, "foo", 3));
      printf("hash result %d\n", stringhash9a_set(sht, "bar", 3));
@@ -71,6 +141,7 @@ int main () {
 
      return 0;
 }
+#endif // SH9A_NO_MAIN
 
 //compute log2 of an unsigned int
 // by Eric Cole - http://graphics.stanford.edu/~seander/bithacks.htm
@@ -92,7 +163,15 @@ uint32_t sh9a_uint32_log2(uint32_t v) {
 
 }
 
-int check_sh9a_max_records(uint32_t max_records) {
+//log2 of a 64 bit value, for sizes past 4G
+uint32_t sh9a_uint64_log2(uint64_t v) {
+     if (v >> 32) {
+          return 32 + sh9a_uint32_log2((uint32_t)(v >> 32));
+     }
+     return sh9a_uint32_log2((uint32_t)v);
+}
+
+uint64_t check_sh9a_max_records(size_t max_records) {
 
      //note the minimum table size for sh9a
      if(max_records < 84) {
@@ -101,39 +180,62 @@ int check_sh9a_max_records(uint32_t max_records) {
      }
 
      // 42 == 21 items per bucket, 2 tables 
-     uint32_t ibits = sh9a_uint32_log2((uint32_t)(max_records/42)) + 1;
-     int mxr = (1<<(ibits)) * 21 * 2;
+     uint32_t ibits = sh9a_uint64_log2((uint64_t)(max_records/42)) + 1;
+     uint64_t mxr = ((uint64_t)1<<(ibits)) * 21 * 2;
 
      return mxr;
 }
 
 
 
-stringhash9a_t * sh9a_create_ibits(uint32_t ibits) {
+//hash seed for a new table.. builds with -DSH9A_SEED=n use n every time, so
+// runs are reproducible
+static uint32_t sh9a_new_seed(void) {
+#ifdef SH9A_SEED
+     return (uint32_t)(SH9A_SEED);
+#else
+     return (uint32_t)rand();
+#endif
+}
+
+//create a table with index_size buckets in each of the 2 tables.. power of
+// two sizes pick index bits with mask_index, any other size maps hashes onto
+// buckets with multiply-shift range reduction
+stringhash9a_t * sh9a_create_index(uint64_t index_size) {
      stringhash9a_t * sht;
+
+     //both tables together have to be addressable by a bucket index
+     if ((index_size * 2 - 1) > (uint64_t)(sh9a_index_t)~0) {
+          dprint("stringhash9a index size too large for this build");
+          return NULL;
+     }
      sht = (stringhash9a_t *)calloc(1, sizeof(stringhash9a_t));
      if (!sht) {
           dprint("failed calloc of stringhash9a hash table");
           return NULL;
      }
 
-     sht->ibits = ibits;
-     sht->index_size = 1<<(ibits);
-     dprint("index size %u", sht->index_size);
+     sht->ibits = sh9a_uint64_log2(index_size);
+     sht->index_size = index_size;
+     dprint("index size %"PRIu64, sht->index_size);
      sht->max_insert_cnt = sht->index_size >> 4;
-     sht->table_bit = 1<<(ibits);
+     sht->table_bit = index_size;
 
-     dprint("table bit %u", sht->table_bit);
-     sht->mask_index = ((uint64_t)~0)>>(64-(ibits));
+     dprint("table bit %"PRIu64, sht->table_bit);
+     if ((index_size & (index_size - 1)) == 0) {
+          sht->mask_index = index_size - 1;
+     }
      dprint("maskindex %"PRIu64, sht->mask_index);
      sht->max_records = sht->index_size * 21 * 2;
 
-     sht->hash_seed = (uint32_t)rand();
+     sht->hash_seed = sh9a_new_seed();
      sht->epoch = 1;
 
-     // now to allocate memory...
-     sht->buckets = (sh9a_bucket_t *)calloc(sht->index_size * 2,
-                                            sizeof(sh9a_bucket_t));
+     // now to allocate memory... (size_t can be narrower than the request)
+     if ((size_t)(sht->index_size * 2) == sht->index_size * 2) {
+          sht->buckets = (sh9a_bucket_t *)calloc((size_t)(sht->index_size * 2),
+                                                 sizeof(sh9a_bucket_t));
+     }
 
      if (!sht->buckets) {
           free(sht);
@@ -147,7 +249,11 @@ stringhash9a_t * sh9a_create_ibits(uint32_t ibits) {
      return sht;
 }
 
-stringhash9a_t * stringhash9a_create(uint32_t max_records) {
+stringhash9a_t * sh9a_create_ibits(uint32_t ibits) {
+     return sh9a_create_index((uint64_t)1<<(ibits));
+}
+
+stringhash9a_t * stringhash9a_create(size_t max_records) {
      stringhash9a_t * sht;
 
      //note the minimum table size for sh9a
@@ -158,7 +264,7 @@ stringhash9a_t * stringhash9a_create(uint32_t max_records) {
 
      //create the stringhash9a table from scratch
      // 42 == 21 items per bucket, 2 tables 
-     uint32_t ibits = sh9a_uint32_log2((uint32_t)(max_records/42)) + 1;
+     uint32_t ibits = sh9a_uint64_log2((uint64_t)(max_records/42)) + 1;
 
      sht = sh9a_create_ibits(ibits);
      if (!(sht)) {
@@ -169,6 +275,60 @@ stringhash9a_t * stringhash9a_create(uint32_t max_records) {
      return sht;
 }
 
+//create a table with exactly enough buckets for max_records, rather than
+// rounding up to the next power of two
+stringhash9a_t * stringhash9a_create_records(size_t max_records) {
+     // 42 == 21 items per bucket, 2 tables
+     uint64_t index_size = ((uint64_t)max_records + 41) / 42;
+     if (!index_size) {
+          index_size = 1;
+     }
+     return sh9a_create_index(index_size);
+}
+
+//create the largest table whose memory use fits within max_bytes
+stringhash9a_t * stringhash9a_create_bytes(uint64_t max_bytes) {
+     if (max_bytes < sizeof(stringhash9a_t) + 2 * sizeof(sh9a_bucket_t)) {
+          dprint("stringhash9a_create_bytes: budget too small");
+          return NULL;
+     }
+     uint64_t index_size = (max_bytes - sizeof(stringhash9a_t)) /
+          (2 * sizeof(sh9a_bucket_t));
+     uint64_t max_index = ((uint64_t)(sh9a_index_t)~0 >> 1) + 1;
+     if (index_size > max_index) {
+          index_size = max_index;
+     }
+     return sh9a_create_index(index_size);
+}
+
+//create a table using one of the SH9A_MODE_* placement modes.. cuckoo
+// mode takes precedence over blocked, and tables smaller than one block
+// fall back to the default layout
+stringhash9a_t * stringhash9a_create_mode(size_t max_records, uint32_t mode) {
+     stringhash9a_t * sht = stringhash9a_create(max_records);
+     if (!sht) {
+          return NULL;
+     }
+     if ((mode & SH9A_MODE_BLOCKED) &&
+         (((uint64_t)sht->index_size * 2) < SH9A_BLOCK_BUCKETS)) {
+          dprint("stringhash9a table too small for blocked mode");
+          mode &= ~SH9A_MODE_BLOCKED;
+     }
+     sht->mode = mode;
+     return sht;
+}
+
+//create a table with a caller supplied hash seed.. tables that share a seed
+// and size map a key to the same buckets and digests
+stringhash9a_t * stringhash9a_create_seed(size_t max_records, uint32_t seed) {
+     stringhash9a_t * sht = stringhash9a_create(max_records);
+     if (!sht) {
+          return NULL;
+     }
+     sht->hash_seed = seed;
+     return sht;
+}
+
 
 //steal bytes from digests.. populate
 #define sh9a_build_leftover(i, lookup, digest) do { \
@@ -331,9 +491,9 @@ void sh9a_sort_lru_upper(uint32_t * d, uint8_t mru) {
 #endif
 #undef GCC_VERSION
 
-//given an index and bucket.. find state data...
-int sh9a_lookup_bucket(sh9a_bucket_t * bucket,
-                                     uint32_t digest) {
+//find digest in a bucket and move it to the front.. returns the LRU
+// position it was found at, or -1
+static inline int sh9a_touch_bucket(sh9a_bucket_t * bucket, uint32_t digest) {
      int i;
 
      uint32_t * dp = bucket->digest;
@@ -341,22 +501,29 @@ int sh9a_lookup_bucket(sh9a_bucket_t * bucket,
      for (i = 0 ; i < SH9A_DEPTH; i++) {
           if (digest == (dp[i] & SH9A_DIGEST_MASK)) {
                sh9a_sort_lru_lower(dp, i);
-               return 1;
+               return i;
           }
           sh9a_build_leftover(i, leftover, dp[i]);
      }
      for (i = 0; i < 5; i++) {
           if (digest == leftover[i]) {
                sh9a_sort_lru_upper(dp, i+16);
-               return 1;
+               return i+16;
           }
      }
-     return 0;
+     return -1;
 }
 
-// lookup bucket.. count zeros in bucket
-int sh9a_lookup_bucket2(sh9a_bucket_t * bucket,
-                                      uint32_t digest, uint32_t * zeros) {
+//given an index and bucket.. find state data...
+int sh9a_lookup_bucket(sh9a_bucket_t * bucket,
+                                     uint32_t digest) {
+     return sh9a_touch_bucket(bucket, digest) >= 0;
+}
+
+// lookup bucket.. count zeros in bucket.  returns the LRU position the
+// digest was found at (and moved to the front from), or -1
+static inline int sh9a_touch_bucket2(sh9a_bucket_t * bucket,
+                                     uint32_t digest, uint32_t * zeros) {
      int i;
 
      *zeros = 0;
@@ -367,7 +534,7 @@ int sh9a_lookup_bucket2(sh9a_bucket_t * bucket,
           dcmp = dp[i] & SH9A_DIGEST_MASK;
           if (digest == dcmp) {
                sh9a_sort_lru_lower(dp, i);
-               return 1;
+               return i;
           }
           *zeros += dcmp ? 0 : 1;
           sh9a_build_leftover(i, leftover, dp[i]);
@@ -375,29 +542,58 @@ int sh9a_lookup_bucket2(sh9a_bucket_t * bucket,
      for (i = 0; i < 5; i++) {
           if (digest == leftover[i]) {
                sh9a_sort_lru_upper(dp, i+16);
-               return 1;
+               return i+16;
           }
           *zeros += leftover[i] ? 0 : 1;
      }
-     return 0;
+     return -1;
+}
+
+int sh9a_lookup_bucket2(sh9a_bucket_t * bucket,
+                                      uint32_t digest, uint32_t * zeros) {
+     return sh9a_touch_bucket2(bucket, digest, zeros) >= 0;
 }
 
 #define SH9A_PERMUTE1 0xed31952d18a569ddULL
 #define SH9A_PERMUTE2 0x94e36ad1c8d2654bULL
-void sh9a_gethash(stringhash9a_t * sht,
-                                uint8_t * key, uint32_t keylen,
-                                uint32_t *h1, uint32_t *h2,
-                                uint32_t *pd1, uint32_t *pd2) {
+#define SH9A_PERMUTE3 0xc2b2ae3d27d4eb4fULL
 
-     dprint("trying to hash %.*s", keylen, key);
-     uint64_t m = evahash64(key, keylen, sht->hash_seed);
+//multiply-shift range reduction.. map a 32 bit value onto [0, n)
+static inline uint64_t sh9a_range(uint32_t x, uint64_t n) {
+     return (uint64_t)x * (n >> 32) + (((uint64_t)x * (n & 0xFFFFFFFFULL)) >> 32);
+}
+
+//map the upper bits of a hash product onto [0, n).. 32 bits are plenty up
+// to 4G buckets, past that a 32 bit input would leave buckets unreachable,
+// so wide tables take the top of a 128 bit product instead
+static inline uint64_t sh9a_index_range(uint64_t p, uint64_t n) {
+#if defined(SH9A_INDEX64) && defined(__SIZEOF_INT128__)
+     if (n >> 32) {
+          //low digest bits left out, as with the 32 bit path
+          return (uint64_t)(((unsigned __int128)(p & ~(uint64_t)SH9A_DIGEST_MASK2) * n) >> 64);
+     }
+#endif
+     return sh9a_range((uint32_t)(p >> 32), n);
+}
+
+//cuckoo mode: the other bucket for a digest stored in bucket h.. computed
+// as f(digest) - h over the whole bucket array, so applying it twice gets
+// back to h and an entry can always find its way between its two buckets
+sh9a_index_t sh9a_alt_index(stringhash9a_t * sht, sh9a_index_t h, uint32_t digest) {
+     uint64_t n = sht->index_size * 2;
+     uint64_t f = sh9a_index_range((uint64_t)digest * SH9A_PERMUTE2, n);
+     return (sh9a_index_t)((f >= h) ? (f - h) : (f + n - h));
+}
+
+void sh9a_gethash3(stringhash9a_t * sht,
+                                 uint64_t hash,
+                                 sh9a_index_t *h1, sh9a_index_t *h2,
+                                 uint32_t *pd1, uint32_t *pd2) {
+
+     uint64_t m = hash;
      uint64_t p1 = m * SH9A_PERMUTE1;
      uint64_t p2 = m * SH9A_PERMUTE2;
      uint64_t lh1, lh2;
-     lh1 = (p1 >> SH9A_DIGEST_BITS) & sht->mask_index;
-     lh2 = ((p2 >> SH9A_DIGEST_BITS) & sht->mask_index) | sht->table_bit;
-     *h1 = (uint32_t)lh1;
-     *h2 = (uint32_t)lh2;
 
      uint32_t d1, d2;
      d1 = (uint32_t)(p1 & SH9A_DIGEST_MASK2) << SH9A_DIGEST_SHIFT;
@@ -406,54 +602,73 @@ void sh9a_gethash(stringhash9a_t * sht,
      //make sure digest not zero - if so, set to default
      *pd1 = d1 ? d1 : SH9A_DIGEST_DEFAULT;
      *pd2 = d2 ? d2 : SH9A_DIGEST_DEFAULT;
+
+     if (sht->mode & SH9A_MODE_CUCKOO) {
+          //one digest for both buckets, the second bucket comes from the first
+          lh1 = sh9a_index_range(p1, sht->index_size * 2);
+          *h1 = (sh9a_index_t)lh1;
+          *h2 = sh9a_alt_index(sht, *h1, *pd1);
+          *pd2 = *pd1;
+          return;
+     }
+
+     if (sht->mode & SH9A_MODE_BLOCKED) {
+          //blocked two-choice.. pick a block, then one bucket from each half
+          // of it, so both probes land in the same page
+          uint64_t nblocks = (sht->index_size * 2) / SH9A_BLOCK_BUCKETS;
+          uint64_t base = sh9a_index_range(p1, nblocks) * SH9A_BLOCK_BUCKETS;
+          uint64_t p3 = m * SH9A_PERMUTE3;
+          lh1 = base + sh9a_range((uint32_t)(p2 >> 32), SH9A_BLOCK_BUCKETS / 2);
+          lh2 = base + SH9A_BLOCK_BUCKETS / 2 +
+               sh9a_range((uint32_t)(p3 >> 32), SH9A_BLOCK_BUCKETS / 2);
+          *h1 = (sh9a_index_t)lh1;
+          *h2 = (sh9a_index_t)lh2;
+          return;
+     }
+
+     if (sht->mask_index) {
+          lh1 = (p1 >> SH9A_DIGEST_BITS) & sht->mask_index;
+          lh2 = (p2 >> SH9A_DIGEST_BITS) & sht->mask_index;
+     }
+     else {
+          //not a power of two.. multiply-shift range reduction on the upper
+          // bits, which stay clear of the digest bits
+          lh1 = sh9a_index_range(p1, sht->index_size);
+          lh2 = sh9a_index_range(p2, sht->index_size);
+     }
+     *h1 = (sh9a_index_t)lh1;
+     *h2 = (sh9a_index_t)(lh2 + sht->table_bit);
+}
+
+void sh9a_gethash(stringhash9a_t * sht,
+                                uint8_t * key, uint32_t keylen,
+                                sh9a_index_t *h1, sh9a_index_t *h2,
+                                uint32_t *pd1, uint32_t *pd2) {
+
+     dprint("trying to hash %.*s", keylen, key);
+     uint64_t m = evahash64(key, keylen, sht->hash_seed);
+     sh9a_gethash3(sht, m, h1, h2, pd1, pd2);
 }
 
 void sh9a_gethash2(stringhash9a_t * sht,
                                  uint8_t * key, uint32_t keylen,
-                                 uint32_t *h1, uint32_t *h2,
+                                 sh9a_index_t *h1, sh9a_index_t *h2,
                                  uint32_t *pd1, uint32_t *pd2,
                                  uint64_t *hash) {
 
      uint64_t m = evahash64(key, keylen, sht->hash_seed);
      *hash = m;
-     uint64_t p1 = m * SH9A_PERMUTE1;
-     uint64_t p2 = m * SH9A_PERMUTE2;
-     uint64_t lh1, lh2;
-     lh1 = (p1 >> SH9A_DIGEST_BITS) & sht->mask_index;
-     lh2 = ((p2 >> SH9A_DIGEST_BITS) & sht->mask_index) | sht->table_bit;
-     *h1 = (uint32_t)lh1;
-     *h2 = (uint32_t)lh2;
-
-     uint32_t d1, d2;
-     d1 = (uint32_t)(p1 & SH9A_DIGEST_MASK2) << SH9A_DIGEST_SHIFT;
-     d2 = (uint32_t)(p2 & SH9A_DIGEST_MASK2) << SH9A_DIGEST_SHIFT;
-
-     //make sure digest not zero - if so, set to default
-     *pd1 = d1 ? d1 : SH9A_DIGEST_DEFAULT;
-     *pd2 = d2 ? d2 : SH9A_DIGEST_DEFAULT;
+     sh9a_gethash3(sht, m, h1, h2, pd1, pd2);
 }
 
-void sh9a_gethash3(stringhash9a_t * sht,
-                                 uint64_t hash,
-                                 uint32_t *h1, uint32_t *h2,
-                                 uint32_t *pd1, uint32_t *pd2) {
-
-     uint64_t m = hash;
-     uint64_t p1 = m * SH9A_PERMUTE1;
-     uint64_t p2 = m * SH9A_PERMUTE2;
-     uint64_t lh1, lh2;
-     lh1 = (p1 >> SH9A_DIGEST_BITS) & sht->mask_index;
-     lh2 = ((p2 >> SH9A_DIGEST_BITS) & sht->mask_index) | sht->table_bit;
-     *h1 = (uint32_t)lh1;
-     *h2 = (uint32_t)lh2;
-
-     uint32_t d1, d2;
-     d1 = (uint32_t)(p1 & SH9A_DIGEST_MASK2) << SH9A_DIGEST_SHIFT;
-     d2 = (uint32_t)(p2 & SH9A_DIGEST_MASK2) << SH9A_DIGEST_SHIFT;
-
-     //make sure digest not zero - if so, set to default
-     *pd1 = d1 ? d1 : SH9A_DIGEST_DEFAULT;
-     *pd2 = d2 ? d2 : SH9A_DIGEST_DEFAULT;
+//return the bucket at index h.. if lazy flush is enabled and the bucket was
+// last touched before the most recent flush, clear it first
+static inline sh9a_bucket_t * sh9a_get_bucket(stringhash9a_t * sht, sh9a_index_t h) {
+     if (sht->gen && (sht->gen[h] != sht->generation)) {
+          memset(&sht->buckets[h], 0, sizeof(sh9a_bucket_t));
+          sht->gen[h] = sht->generation;
+     }
+     return &sht->buckets[h];
 }
 
 void sh9a_shift_new(uint32_t * d, uint32_t a) {
@@ -503,29 +718,327 @@ void sh9a_shift_new(uint32_t * d, uint32_t a) {
      d[0] |= a; 
 }
 
-int stringhash9a_check_posthash(stringhash9a_t * sht,
-                                              uint32_t h1, uint32_t h2,
-                                              uint32_t d1, uint32_t d2) {
-     if (sh9a_lookup_bucket(&sht->buckets[h1], d1)) {
-          return 1;
+//return the stash line covering bucket h, clearing it first if it is left
+// over from before the last lazy flush
+static inline sh9a_stash_t * sh9a_get_stash(stringhash9a_t * sht, sh9a_index_t h) {
+     uint64_t line = h / SH9A_STASH_GROUP;
+     if (sht->gen && (sht->stash_gen[line] != sht->generation)) {
+          memset(&sht->stash[line], 0, sizeof(sh9a_stash_t));
+          sht->stash_gen[line] = sht->generation;
+     }
+     return &sht->stash[line];
+}
+
+//key hashes for a stash line in verify mode, NULL otherwise
+static inline uint64_t * sh9a_stash_fp(stringhash9a_t * sht, sh9a_stash_t * st) {
+     if (!sht->stash_fp) {
+          return NULL;
+     }
+     return &sht->stash_fp[(uint64_t)(st - sht->stash) * SH9A_STASH_DEPTH];
+}
+
+//find a spilled entry for bucket h.. returns its slot or -1
+static inline int sh9a_stash_find(stringhash9a_t * sht, sh9a_stash_t * st,
+                                  sh9a_index_t h, uint32_t digest, uint64_t hash) {
+     uint64_t * fp = sh9a_stash_fp(sht, st);
+     int i;
+     for (i = 0; i < SH9A_STASH_DEPTH; i++) {
+          if ((st->h[i] == (uint32_t)h) &&
+              ((st->digest[i] & SH9A_DIGEST_MASK) == digest) &&
+              (!fp || (fp[i] == hash))) {
+               return i;
+          }
+     }
+     return -1;
+}
+
+//look for a key among entries spilled from either of its buckets.. returns
+// epochs since it was spilled, or -1.  if remove is set, a matching entry is
+// taken out of the stash
+static int sh9a_stash_age(stringhash9a_t * sht, uint64_t hash,
+                          sh9a_index_t h1, sh9a_index_t h2,
+                          uint32_t d1, uint32_t d2, int remove) {
+     sh9a_stash_t * st;
+     int slot;
+
+     st = sh9a_get_stash(sht, h1);
+     slot = sh9a_stash_find(sht, st, h1, d1, hash);
+     if (slot < 0) {
+          st = sh9a_get_stash(sht, h2);
+          slot = sh9a_stash_find(sht, st, h2, d2, hash);
+     }
+     if (slot < 0) {
+          return -1;
+     }
+     int age = (uint8_t)(sht->epoch - (uint8_t)(st->digest[slot] & SH9A_LEFTOVER_MASK));
+     sht->stash_hits++;
+     if (remove) {
+          st->h[slot] = 0;
+          st->digest[slot] = 0;
+     }
+     return age;
+}
+
+int sh9a_stash_lookup(stringhash9a_t * sht, uint64_t hash,
+                      sh9a_index_t h1, sh9a_index_t h2,
+                      uint32_t d1, uint32_t d2, int remove) {
+     return sh9a_stash_age(sht, hash, h1, h2, d1, d2, remove) >= 0;
+}
+
+//digest in the least recently used position (20) of a bucket
+static inline uint32_t sh9a_lru_tail(uint32_t * d) {
+     return ((d[12] & SH9A_LEFTOVER_MASK)<<8) +
+          ((d[13] & SH9A_LEFTOVER_MASK)<<16) +
+          ((d[14] & SH9A_LEFTOVER_MASK)<<24);
+}
+
+//park an entry pushed out of full bucket h in the stash.. an entry is only
+// lost (a drop) when the stash line is full too, and then the longest
+// stashed entry goes.  victim_fp is the entry's key hash in verify mode
+void sh9a_stash_spill(stringhash9a_t * sht, sh9a_index_t h, uint32_t victim,
+                      uint64_t victim_fp) {
+     sh9a_stash_t * st = sh9a_get_stash(sht, h);
+     uint64_t * fp = sh9a_stash_fp(sht, st);
+     int i;
+     int slot = 0;
+     uint8_t oldest = 0;
+
+     for (i = 0; i < SH9A_STASH_DEPTH; i++) {
+          if (!(st->digest[i] & SH9A_DIGEST_MASK)) {
+               slot = i;
+               break;
+          }
+          uint8_t age = sht->epoch - (uint8_t)(st->digest[i] & SH9A_LEFTOVER_MASK);
+          if (age >= oldest) {
+               oldest = age;
+               slot = i;
+          }
+     }
+     if (i == SH9A_STASH_DEPTH) {
+          sht->drops++;
+     }
+     //the line already pins down the upper bits of the bucket index
+     st->h[slot] = (uint32_t)h;
+     st->digest[slot] = victim | sht->epoch;
+     if (fp) {
+          fp[slot] = victim_fp;
+     }
+     sht->stash_cnt++;
+}
+
+//verify mode: key hashes for bucket h, kept in the same LRU order as the
+// bucket's digests so every slot has its full hash alongside
+static inline uint64_t * sh9a_verify_fp(stringhash9a_t * sht, sh9a_index_t h) {
+     return &sht->verify[(uint64_t)h * SH9A_VERIFY_SLOTS];
+}
+
+//digest at LRU position pos of a bucket
+static inline uint32_t sh9a_get_slot(uint32_t * d, int pos) {
+     if (pos < SH9A_DEPTH) {
+          return d[pos] & SH9A_DIGEST_MASK;
+     }
+     int i = (pos - 16) * 3;
+     return ((d[i] & SH9A_LEFTOVER_MASK)<<8) +
+          ((d[i+1] & SH9A_LEFTOVER_MASK)<<16) +
+          ((d[i+2] & SH9A_LEFTOVER_MASK)<<24);
+}
+
+//count empty positions in a bucket
+static inline uint32_t sh9a_count_zeros(uint32_t * d) {
+     uint32_t zeros = 0;
+     int i;
+     for (i = 0; i < SH9A_VERIFY_SLOTS; i++) {
+          zeros += sh9a_get_slot(d, i) ? 0 : 1;
+     }
+     return zeros;
+}
+
+//push hash onto the front of a fingerprint list, the same move sh9a_shift_new
+// makes on the digests.. returns the hash pushed off the end
+static inline uint64_t sh9a_verify_shift_new(uint64_t * fp, uint64_t hash) {
+     uint64_t tail = fp[SH9A_VERIFY_SLOTS - 1];
+     memmove(&fp[1], &fp[0], (SH9A_VERIFY_SLOTS - 1) * sizeof(uint64_t));
+     fp[0] = hash;
+     return tail;
+}
+
+//find a key in bucket h in verify mode.. a digest match only counts when
+// the hash stored at the same position is the key's own, so a hit is exact
+// up to a full 64 bit hash collision.  returns the position or -1
+static int sh9a_verify_find(stringhash9a_t * sht, sh9a_index_t h,
+                            uint32_t digest, uint64_t hash) {
+     uint32_t * d = sh9a_get_bucket(sht, h)->digest;
+     uint64_t * fp = sh9a_verify_fp(sht, h);
+     int pos;
+
+     //misses stay on the bucket's cache line
+     for (pos = 0; pos < SH9A_VERIFY_SLOTS; pos++) {
+          if (sh9a_get_slot(d, pos) == digest) {
+               break;
+          }
+     }
+     if (pos == SH9A_VERIFY_SLOTS) {
+          return -1;
+     }
+     if (fp[pos] == hash) {
+          return pos;
+     }
+     //digest collision with another key.. ours may still be further down
+     for (pos++; pos < SH9A_VERIFY_SLOTS; pos++) {
+          if ((fp[pos] == hash) && (sh9a_get_slot(d, pos) == digest)) {
+               return pos;
+          }
+     }
+     sht->verify_rejects++;
+     return -1;
+}
+
+//verify mode lookup.. on a hit moves the entry to the front of the bucket
+// and its fingerprints alike.  returns the position it was found at or -1
+static int sh9a_verify_touch(stringhash9a_t * sht, sh9a_index_t h,
+                             uint32_t digest, uint64_t hash) {
+     int pos = sh9a_verify_find(sht, h, digest, hash);
+     if (pos > 0) {
+          uint32_t * d = sht->buckets[h].digest;
+          uint64_t * fp = sh9a_verify_fp(sht, h);
+          if (pos < SH9A_DEPTH) {
+               sh9a_sort_lru_lower(d, pos);
+          }
+          else {
+               sh9a_sort_lru_upper(d, pos);
+          }
+          memmove(&fp[1], &fp[0], pos * sizeof(uint64_t));
+          fp[0] = hash;
+     }
+     return pos;
+}
+
+static inline int sh9a_verify_lookup(stringhash9a_t * sht, sh9a_index_t h,
+                                     uint32_t digest, uint64_t hash) {
+     return sh9a_verify_touch(sht, h, digest, hash) >= 0;
+}
+
+//the front cache is direct mapped by the bucket a key was found in, so an
+// entry can be found again from the bucket when the key leaves it.  each
+// slot holds the full 64 bit key hash, and front_epoch the epoch it was
+// filled in (0 for an empty slot)
+static inline int sh9a_front_match(stringhash9a_t * sht, uint64_t slot,
+                                   uint64_t hash) {
+     return sht->front_epoch[slot] && (sht->front[slot] == hash) &&
+          ((uint8_t)(sht->epoch - sht->front_epoch[slot]) < SH9A_FRONT_MAX_AGE);
+}
+
+//front cache hit.. a key may sit under either of its buckets.  entries
+// older than SH9A_FRONT_MAX_AGE epochs are ignored so a hot key goes back
+// through the table now and then, refreshing its LRU position there.  the
+// cache is cleared whenever the epoch wraps, so the 8 bit age never aliases
+static inline int sh9a_front_hit(stringhash9a_t * sht, uint64_t hash,
+                                 sh9a_index_t h1, sh9a_index_t h2) {
+     sht->front_lookups++;
+     if (!sh9a_front_match(sht, h1 & sht->front_mask, hash) &&
+         !sh9a_front_match(sht, h2 & sht->front_mask, hash)) {
+          return 0;
+     }
+     sht->front_hits++;
+     return 1;
+}
+
+//remember a key just found in bucket h.. nothing is cached in the epoch
+// right after a wrap, as 0 marks an empty slot
+static inline void sh9a_front_add(stringhash9a_t * sht, uint64_t hash,
+                                  sh9a_index_t h) {
+     if (sht->front) {
+          uint64_t slot = h & sht->front_mask;
+          sht->front[slot] = hash;
+          sht->front_epoch[slot] = sht->epoch;
+     }
+}
+
+static inline void sh9a_front_remove(stringhash9a_t * sht, uint64_t hash,
+                                     sh9a_index_t h1, sh9a_index_t h2) {
+     if (sht->front[h1 & sht->front_mask] == hash) {
+          sht->front_epoch[h1 & sht->front_mask] = 0;
+     }
+     if (sht->front[h2 & sht->front_mask] == hash) {
+          sht->front_epoch[h2 & sht->front_mask] = 0;
      }
-     if (sh9a_lookup_bucket(&sht->buckets[h2], d2)) {
+}
+
+//digest v is leaving bucket h - pushed out, kicked on or spilled.. if the
+// key cached under h has that digest there, it is the one leaving, so its
+// entry goes too
+static inline void sh9a_front_evict(stringhash9a_t * sht, sh9a_index_t h,
+                                    uint32_t v) {
+     uint64_t slot = h & sht->front_mask;
+     if (!v || !sht->front_epoch[slot]) {
+          return;
+     }
+     sh9a_index_t c1, c2;
+     uint32_t e1, e2;
+     sh9a_gethash3(sht, sht->front[slot], &c1, &c2, &e1, &e2);
+     if (((c1 == h) && (e1 == v)) || ((c2 == h) && (e2 == v))) {
+          sht->front_epoch[slot] = 0;
+     }
+}
+
+static int sh9a_check_table(stringhash9a_t * sht, uint64_t hash,
+                            sh9a_index_t h1, sh9a_index_t h2,
+                            uint32_t d1, uint32_t d2) {
+     int in1, in2 = 0;
+     if (sht->verify) {
+          in1 = sh9a_verify_lookup(sht, h1, d1, hash);
+          if (!in1) {
+               in2 = sh9a_verify_lookup(sht, h2, d2, hash);
+          }
+     }
+     else {
+          in1 = sh9a_lookup_bucket(sh9a_get_bucket(sht, h1), d1);
+          if (!in1) {
+               in2 = sh9a_lookup_bucket(sh9a_get_bucket(sht, h2), d2);
+          }
+     }
+     if (in1 || in2) {
+          sh9a_front_add(sht, hash, in1 ? h1 : h2);
           return 1;
      }
+     //stash is only probed once something has spilled into it.. stashed
+     // keys are not cached in front, as they are in no bucket
+     if (sht->stash_cnt) {
+          return sh9a_stash_lookup(sht, hash, h1, h2, d1, d2, 0);
+     }
      return 0;
      
 }
 
+int stringhash9a_check_posthash(stringhash9a_t * sht, uint64_t hash,
+                                              sh9a_index_t h1, sh9a_index_t h2,
+                                              uint32_t d1, uint32_t d2) {
+     int found;
+     if (!sht->front) {
+          found = sh9a_check_table(sht, hash, h1, h2, d1, d2);
+     }
+     //keys found more than once are served from the front cache
+     else if (sh9a_front_hit(sht, hash, h1, h2)) {
+          found = 1;
+     }
+     else {
+          found = sh9a_check_table(sht, hash, h1, h2, d1, d2);
+     }
+     SH9A_TRACE_OP(sht, SH9A_TRACE_CHECK, hash, found);
+     return found;
+}
+
 //find records using hashkeys.. return 1 if found
 int stringhash9a_check(stringhash9a_t * sht,
                                      void * key, int keylen) {
 
-     uint32_t h1, h2;
+     sh9a_index_t h1, h2;
      uint32_t d1, d2;
+     uint64_t hash;
 
-     sh9a_gethash(sht, (uint8_t*)key, keylen, &h1, &h2, &d1, &d2);
+     sh9a_gethash2(sht, (uint8_t*)key, keylen, &h1, &h2, &d1, &d2, &hash);
 
-     return stringhash9a_check_posthash(sht, h1, h2, d1, d2);
+     return stringhash9a_check_posthash(sht, hash, h1, h2, d1, d2);
 }
 
 //find records using hashkeys.. return 1 if found
@@ -533,27 +1046,27 @@ int stringhash9a_check_gethash(stringhash9a_t * sht,
                                              void * key, int keylen,
                                              uint64_t * phash) {
 
-     uint32_t h1, h2;
+     sh9a_index_t h1, h2;
      uint32_t d1, d2;
 
      sh9a_gethash2(sht, (uint8_t*)key, keylen, &h1, &h2, &d1, &d2, phash);
 
-     return stringhash9a_check_posthash(sht, h1, h2, d1, d2);
+     return stringhash9a_check_posthash(sht, *phash, h1, h2, d1, d2);
 }
 
 //find records using hashkeys.. return 1 if found
 int stringhash9a_check_hash(stringhash9a_t * sht,
                                           uint64_t hash) {
 
-     uint32_t h1, h2;
+     sh9a_index_t h1, h2;
      uint32_t d1, d2;
 
      sh9a_gethash3(sht, hash, &h1, &h2, &d1, &d2);
 
-     return stringhash9a_check_posthash(sht, h1, h2, d1, d2);
+     return stringhash9a_check_posthash(sht, hash, h1, h2, d1, d2);
 }
 
-int sh9a_cmp_epoch(stringhash9a_t * sht, uint32_t h1, uint32_t h2,
+int sh9a_cmp_epoch(stringhash9a_t * sht, sh9a_index_t h1, sh9a_index_t h2,
                                  uint32_t d1) {
      uint8_t e1, e2;
      uint8_t diff1, diff2;
@@ -587,73 +1100,284 @@ void sh9a_update_bucket_epoch(stringhash9a_t * sht, sh9a_bucket_t * bucket) {
      if (sht->insert_cnt > sht->max_insert_cnt) {
           sht->insert_cnt = 0;
           sht->epoch++;
+          //front cache entries carry the 8 bit epoch they were filled in..
+          // drop them all when it wraps, so an old entry cannot read as fresh
+          if (!sht->epoch && sht->front) {
+               memset(sht->front_epoch, 0, sht->front_mask + 1);
+          }
      }
      bucket->digest[15] &= SH9A_DIGEST_MASK;
      bucket->digest[15] |= (uint32_t)sht->epoch;
 }
 
 
-int stringhash9a_set_posthash(stringhash9a_t * sht,
-                                            uint32_t h1, uint32_t h2,
-                                            uint32_t d1, uint32_t d2) {
-     uint32_t zeros1, zeros2;
-
-     if (sh9a_lookup_bucket2(&sht->buckets[h1], d1, &zeros1) ||
-         sh9a_lookup_bucket2(&sht->buckets[h2], d2, &zeros2)) {
-          dprint("found in bucket");
-          return 1;
+//first empty position in a bucket, in LRU order, or -1 if full
+static inline int sh9a_empty_slot(uint32_t * d) {
+     int i;
+     for (i = 0; i < SH9A_DEPTH; i++) {
+          if (!(d[i] & SH9A_DIGEST_MASK)) {
+               return i;
+          }
      }
+     for (i = 0; i < 15; i += 3) {
+          if (!(d[i] & SH9A_LEFTOVER_MASK) && !(d[i+1] & SH9A_LEFTOVER_MASK) &&
+              !(d[i+2] & SH9A_LEFTOVER_MASK)) {
+               return 16 + i/3;
+          }
+     }
+     return -1;
+}
 
-     sh9a_bucket_t * bucket;
-
-     //if zeros.. do normal d-left balance
-     if (zeros1 > zeros2) {
-          bucket = &sht->buckets[h1];
-          sh9a_shift_new(bucket->digest, d1);
+//store digest at LRU position pos without moving anything else
+static inline void sh9a_set_slot(uint32_t * d, int pos, uint32_t digest) {
+     if (pos < SH9A_DEPTH) {
+          d[pos] = (d[pos] & SH9A_LEFTOVER_MASK) | digest;
+          return;
      }
-     else if (zeros1 < zeros2) {
-          bucket = &sht->buckets[h2];
-          sh9a_shift_new(bucket->digest, d2);
+     int i = (pos - 16) * 3;
+     d[i] = (d[i] & SH9A_DIGEST_MASK) | ((digest >> 8) & SH9A_LEFTOVER_MASK);
+     d[i+1] = (d[i+1] & SH9A_DIGEST_MASK) | ((digest >> 16) & SH9A_LEFTOVER_MASK);
+     d[i+2] = (d[i+2] & SH9A_DIGEST_MASK) | ((digest >> 24) & SH9A_LEFTOVER_MASK);
+}
+
+//cuckoo mode: digest v was pushed out of bucket h.. move it to its other
+// bucket, taking a free slot or displacing that bucket's LRU entry in turn,
+// for at most SH9A_CUCKOO_KICKS moves.  a moved entry goes to the LRU end
+// of its new bucket: into the tail slot it displaces, or into the first
+// free slot, which is just behind the bucket's entries since deletes and
+// inserts keep them packed toward the front.  so it is the oldest entry
+// there, unless the bucket was empty and it is the only one.  vfp is v's
+// key hash in verify mode
+void sh9a_cuckoo_kick(stringhash9a_t * sht, sh9a_index_t h, uint32_t v,
+                      uint64_t vfp) {
+     int k;
+     for (k = 0; k < SH9A_CUCKOO_KICKS; k++) {
+          h = sh9a_alt_index(sht, h, v);
+          uint32_t * d = sh9a_get_bucket(sht, h)->digest;
+          uint64_t * fp = sht->verify ? sh9a_verify_fp(sht, h) : NULL;
+          int slot = sh9a_empty_slot(d);
+          sht->kicks++;
+          if (slot >= 0) {
+               sh9a_set_slot(d, slot, v);
+               if (fp) {
+                    fp[slot] = vfp;
+               }
+               return;
+          }
+          uint32_t next = sh9a_lru_tail(d);
+          uint64_t nextfp = fp ? fp[20] : 0;
+          if (sht->front) {
+               sh9a_front_evict(sht, h, next);
+          }
+          sh9a_set_slot(d, 20, v);
+          if (fp) {
+               fp[20] = vfp;
+          }
+          v = next;
+          vfp = nextfp;
      }
-     else if (zeros1) { /// its a tie
-          bucket = &sht->buckets[h1];
-          sh9a_shift_new(bucket->digest, d1);
+     //gave up.. the last entry displaced is lost unless there is a stash
+     if (sht->stash) {
+          sh9a_stash_spill(sht, h, v, vfp);
      }
      else {
-          //ok we have to drop an item
           sht->drops++;
-
-          if (sh9a_cmp_epoch(sht, h1, h2, d1)) {
-               bucket = &sht->buckets[h1];
-               sh9a_shift_new(bucket->digest, d1);
-          }
-          else {
-               bucket = &sht->buckets[h2];
-               sh9a_shift_new(bucket->digest, d2);
-          }
      }
+}
 
-     sh9a_update_bucket_epoch(sht, bucket); 
-
+//put a new entry at the front of bucket h, moving the fingerprints along
+// with the digests in verify mode.. returns the key hash pushed off the end.
+// whatever is pushed off the end also loses its front cache entry, even if
+// it goes on to the stash or another bucket
+static inline uint64_t sh9a_push_front(stringhash9a_t * sht, sh9a_index_t h,
+                                       sh9a_bucket_t * bucket,
+                                       uint32_t digest, uint64_t hash) {
+     if (sht->front) {
+          sh9a_front_evict(sht, h, sh9a_lru_tail(bucket->digest));
+     }
+     sh9a_shift_new(bucket->digest, digest);
+     if (sht->verify) {
+          return sh9a_verify_shift_new(sh9a_verify_fp(sht, h), hash);
+     }
      return 0;
 }
 
+//approximate age of the entry at LRU position pos of a bucket.. epochs
+// since the bucket was last written, plus about SH9A_AGE_POS_EPOCHS for each
+// newer entry in front of it
+static inline int sh9a_entry_age(stringhash9a_t * sht, sh9a_bucket_t * bucket,
+                                 int pos) {
+     uint32_t age = (uint8_t)(sht->epoch -
+                              (uint8_t)(bucket->digest[15] & SH9A_LEFTOVER_MASK));
+     age += (uint32_t)pos * SH9A_AGE_POS_EPOCHS;
+     return (age > SH9A_AGE_MAX) ? SH9A_AGE_MAX : (int)age;
+}
+
+//insert or find a key.. if age is given it gets the age of a key that was
+// already present (-1 if new), within the same probe.  a hit only moves to
+// the front of its bucket, as for any set - the bucket epoch stays that of
+// its last insert, since it also picks which bucket evicts
+static int sh9a_set_table(stringhash9a_t * sht, uint64_t hash,
+                          sh9a_index_t h1, sh9a_index_t h2,
+                          uint32_t d1, uint32_t d2, int * age) {
+     uint32_t zeros1, zeros2;
+     sh9a_bucket_t * b1 = sh9a_get_bucket(sht, h1);
+     sh9a_bucket_t * b2 = sh9a_get_bucket(sht, h2);
+     sh9a_bucket_t * hit = b1;
+     sh9a_index_t hit_h = h1;
+     int found = 0;
+     int pos;
+
+     if (sht->verify) {
+          pos = sh9a_verify_touch(sht, h1, d1, hash);
+          if (pos < 0) {
+               hit = b2;
+               hit_h = h2;
+               pos = sh9a_verify_touch(sht, h2, d2, hash);
+          }
+          if (pos < 0) {
+               zeros1 = sh9a_count_zeros(b1->digest);
+               zeros2 = sh9a_count_zeros(b2->digest);
+          }
+     }
+     else {
+          pos = sh9a_touch_bucket2(b1, d1, &zeros1);
+          if (pos < 0) {
+               hit = b2;
+               hit_h = h2;
+               pos = sh9a_touch_bucket2(b2, d2, &zeros2);
+          }
+     }
+     if (pos >= 0) {
+          dprint("found in bucket");
+          if (age) {
+               *age = sh9a_entry_age(sht, hit, pos);
+          }
+          sh9a_front_add(sht, hash, hit_h);
+          return 1;
+     }
+
+     if (age) {
+          *age = -1;
+     }
+     //a spilled entry gets moved back into a bucket like a new insert
+     if (sht->stash_cnt) {
+          int stash_age = sh9a_stash_age(sht, hash, h1, h2, d1, d2, 1);
+          if (stash_age >= 0) {
+               found = 1;
+               if (age) {
+                    *age = stash_age;
+               }
+          }
+     }
+
+     sh9a_bucket_t * bucket;
+
+     //if zeros.. do normal d-left balance
+     if (zeros1 > zeros2) {
+          bucket = b1;
+          sh9a_push_front(sht, h1, bucket, d1, hash);
+     }
+     else if (zeros1 < zeros2) {
+          bucket = b2;
+          sh9a_push_front(sht, h2, bucket, d2, hash);
+     }
+     else if (zeros1) { /// its a tie
+          bucket = b1;
+          sh9a_push_front(sht, h1, bucket, d1, hash);
+     }
+     else if (sht->mode & SH9A_MODE_CUCKOO) {
+          //insert into the older bucket, then rehome what it pushed out
+          sh9a_index_t h = sh9a_cmp_epoch(sht, h1, h2, d1) ? h1 : h2;
+          bucket = (h == h1) ? b1 : b2;
+          uint32_t v = sh9a_lru_tail(bucket->digest);
+          uint64_t vfp = sh9a_push_front(sht, h, bucket, d1, hash);
+          sh9a_cuckoo_kick(sht, h, v, vfp);
+     }
+     else {
+          //ok we have to drop an item.. or spill it to the stash
+          if (!sht->stash) {
+               sht->drops++;
+          }
+
+          sh9a_index_t h = h2;
+          uint32_t d = d2;
+          bucket = b2;
+          if (sh9a_cmp_epoch(sht, h1, h2, d1)) {
+               h = h1;
+               d = d1;
+               bucket = b1;
+          }
+          uint32_t v = sh9a_lru_tail(bucket->digest);
+          uint64_t vfp = sh9a_push_front(sht, h, bucket, d, hash);
+          if (sht->stash) {
+               sh9a_stash_spill(sht, h, v, vfp);
+          }
+     }
+
+     sh9a_update_bucket_epoch(sht, bucket); 
+
+     return found;
+}
+
+int stringhash9a_set_posthash(stringhash9a_t * sht, uint64_t hash,
+                                            sh9a_index_t h1, sh9a_index_t h2,
+                                            uint32_t d1, uint32_t d2) {
+     int found;
+     if (!sht->front) {
+          found = sh9a_set_table(sht, hash, h1, h2, d1, d2, NULL);
+     }
+     else if (sh9a_front_hit(sht, hash, h1, h2)) {
+          found = 1;
+     }
+     else {
+          found = sh9a_set_table(sht, hash, h1, h2, d1, d2, NULL);
+     }
+     SH9A_TRACE_OP(sht, SH9A_TRACE_SET, hash, found);
+     return found;
+}
+
 uint64_t stringhash9a_drop_cnt(stringhash9a_t * sht) {
      return sht->drops;
 }
 
+//feed the cardinality sidecar from the key hash already computed for the
+// table.. the hash is remixed so register choice is independent of bucket
+static inline void sh9a_hll_add(stringhash9a_t * sht, uint64_t hash) {
+     if (!sht->hll) {
+          return;
+     }
+     uint64_t x = hash * 0x9e3779b97f4a7c15ULL;
+     uint32_t idx = (uint32_t)(x >> (64 - sht->hll_bits));
+     uint64_t w = (x << sht->hll_bits) | (1ULL << (sht->hll_bits - 1));
+     uint8_t rank = 1;
+#if defined(__GNUC__)
+     rank += (uint8_t)__builtin_clzll(w);
+#else
+     while (!(w & 0x8000000000000000ULL)) {
+          w <<= 1;
+          rank++;
+     }
+#endif
+     if (rank > sht->hll[idx]) {
+          sht->hll[idx] = rank;
+     }
+}
+
 //find records using hashkeys.. return 1 if found
 int stringhash9a_set(stringhash9a_t * sht,
                                    void * key, int keylen) {
 
-     uint32_t h1, h2;
+     sh9a_index_t h1, h2;
      uint32_t d1, d2;
+     uint64_t hash;
 
-     sh9a_gethash(sht, (uint8_t*)key, keylen, &h1, &h2, &d1, &d2);
+     sh9a_gethash2(sht, (uint8_t*)key, keylen, &h1, &h2, &d1, &d2, &hash);
+     sh9a_hll_add(sht, hash);
 
-     dprint("%u %u %u %u", h1, h2, d1 ,d2);
+     dprint("%"PRIu64" %"PRIu64" %u %u", (uint64_t)h1, (uint64_t)h2, d1, d2);
 
-     return stringhash9a_set_posthash(sht, h1, h2, d1, d2);
+     return stringhash9a_set_posthash(sht, hash, h1, h2, d1, d2);
 
 }
 
@@ -662,12 +1386,13 @@ int stringhash9a_set_gethash(stringhash9a_t * sht,
                                            void * key, int keylen,
                                            uint64_t * phash) {
 
-     uint32_t h1, h2;
+     sh9a_index_t h1, h2;
      uint32_t d1, d2;
 
      sh9a_gethash2(sht, (uint8_t*)key, keylen, &h1, &h2, &d1, &d2, phash);
+     sh9a_hll_add(sht, *phash);
 
-     return stringhash9a_set_posthash(sht, h1, h2, d1, d2);
+     return stringhash9a_set_posthash(sht, *phash, h1, h2, d1, d2);
 
 }
 
@@ -675,15 +1400,435 @@ int stringhash9a_set_gethash(stringhash9a_t * sht,
 int stringhash9a_set_hash(stringhash9a_t * sht,
                                         uint64_t hash) {
 
-     uint32_t h1, h2;
+     sh9a_index_t h1, h2;
+     uint32_t d1, d2;
+
+     sh9a_gethash3(sht, hash, &h1, &h2, &d1, &d2);
+     sh9a_hll_add(sht, hash);
+
+     return stringhash9a_set_posthash(sht, hash, h1, h2, d1, d2);
+}
+
+//find a key and report its age, or -1 if absent.. like a plain check, a hit
+// is moved to the front of its bucket and the bucket epoch is not written.
+// entries that were ahead of it move back one position, so their ages grow
+// by SH9A_AGE_POS_EPOCHS.  stashed entries report the epoch they were
+// spilled
+static int sh9a_age_table(stringhash9a_t * sht, uint64_t hash,
+                          sh9a_index_t h1, sh9a_index_t h2,
+                          uint32_t d1, uint32_t d2) {
+     sh9a_bucket_t * bucket = sh9a_get_bucket(sht, h1);
+     int pos;
+
+     if (sht->verify) {
+          pos = sh9a_verify_touch(sht, h1, d1, hash);
+          if (pos < 0) {
+               bucket = sh9a_get_bucket(sht, h2);
+               pos = sh9a_verify_touch(sht, h2, d2, hash);
+          }
+     }
+     else {
+          pos = sh9a_touch_bucket(bucket, d1);
+          if (pos < 0) {
+               bucket = sh9a_get_bucket(sht, h2);
+               pos = sh9a_touch_bucket(bucket, d2);
+          }
+     }
+     if (pos >= 0) {
+          return sh9a_entry_age(sht, bucket, pos);
+     }
+
+     if (sht->stash_cnt) {
+          return sh9a_stash_age(sht, hash, h1, h2, d1, d2, 0);
+     }
+     return -1;
+}
+
+int sh9a_age_posthash(stringhash9a_t * sht, uint64_t hash,
+                      sh9a_index_t h1, sh9a_index_t h2,
+                      uint32_t d1, uint32_t d2) {
+     int age = sh9a_age_table(sht, hash, h1, h2, d1, d2);
+     SH9A_TRACE_OP(sht, SH9A_TRACE_AGE, hash, age);
+     return age;
+}
+
+//set_get_age once the key is hashed.. the front cache is passed by, since
+// it keeps no ages
+int sh9a_set_age_posthash(stringhash9a_t * sht, uint64_t hash,
+                          sh9a_index_t h1, sh9a_index_t h2,
+                          uint32_t d1, uint32_t d2) {
+     int age;
+     sh9a_set_table(sht, hash, h1, h2, d1, d2, &age);
+     SH9A_TRACE_OP(sht, SH9A_TRACE_SET_AGE, hash, age);
+     return age;
+}
+
+//check a key and return its approximate age in epochs (0..SH9A_AGE_MAX), or
+// -1 if it is not in the table.  an epoch passes every index_size/16 inserts.
+// the epoch counter is 8 bits, so a bucket untouched for 256 epochs or more
+// reads young again
+int stringhash9a_check_get_age(stringhash9a_t * sht, void * key, int keylen) {
+     sh9a_index_t h1, h2;
+     uint32_t d1, d2;
+     uint64_t hash;
+
+     sh9a_gethash2(sht, (uint8_t*)key, keylen, &h1, &h2, &d1, &d2, &hash);
+
+     return sh9a_age_posthash(sht, hash, h1, h2, d1, d2);
+}
+
+//check_get_age for a key hash computed earlier
+int stringhash9a_check_get_age_hash(stringhash9a_t * sht, uint64_t hash) {
+     sh9a_index_t h1, h2;
+     uint32_t d1, d2;
+
+     sh9a_gethash3(sht, hash, &h1, &h2, &d1, &d2);
+
+     return sh9a_age_posthash(sht, hash, h1, h2, d1, d2);
+}
+
+//set a key in the same probe that reports how recently it was seen.. -1 if
+// it was new, otherwise its approximate age in epochs as for
+// stringhash9a_check_get_age.  a hit moves to the front of its bucket like
+// any set, so its age afterwards counts from the bucket's last insert
+int stringhash9a_set_get_age(stringhash9a_t * sht, void * key, int keylen) {
+     sh9a_index_t h1, h2;
+     uint32_t d1, d2;
+     uint64_t hash;
+
+     sh9a_gethash2(sht, (uint8_t*)key, keylen, &h1, &h2, &d1, &d2, &hash);
+     sh9a_hll_add(sht, hash);
+
+     return sh9a_set_age_posthash(sht, hash, h1, h2, d1, d2);
+}
+
+//set_get_age for a key hash computed earlier
+int stringhash9a_set_get_age_hash(stringhash9a_t * sht, uint64_t hash) {
+     sh9a_index_t h1, h2;
      uint32_t d1, d2;
 
      sh9a_gethash3(sht, hash, &h1, &h2, &d1, &d2);
+     sh9a_hll_add(sht, hash);
+
+     return sh9a_set_age_posthash(sht, hash, h1, h2, d1, d2);
+}
+
+
+
+//hash a key given as nsegs separate pieces.. same value as hashing the
+// pieces concatenated, so no scratch copy is needed
+uint64_t sh9a_hash_segments(stringhash9a_t * sht,
+                            sh9a_segment_t * segs, int nsegs) {
+     evahash64_state_t st;
+     int i;
+
+     evahash64_init(&st, sht->hash_seed);
+     for (i = 0; i < nsegs; i++) {
+          evahash64_update(&st, (uint8_t*)segs[i].key, segs[i].keylen);
+     }
+     return evahash64_final(&st);
+}
+
+//find a multi-part key.. return 1 if found
+int stringhash9a_check_segments(stringhash9a_t * sht,
+                                sh9a_segment_t * segs, int nsegs) {
+     return stringhash9a_check_hash(sht, sh9a_hash_segments(sht, segs, nsegs));
+}
+
+//set a multi-part key.. return 1 if found
+int stringhash9a_set_segments(stringhash9a_t * sht,
+                              sh9a_segment_t * segs, int nsegs) {
+     return stringhash9a_set_hash(sht, sh9a_hash_segments(sht, segs, nsegs));
+}
+
+
+
+//hash cnt keys packed back to back in buf into hashes[].. keys of up to
+// SH9A_LANE_MAXLEN bytes are gathered by length and hashed EVAHASH64_LANES
+// at a time with evahash64_lanes, longer ones and stragglers one by one.
+// values are the same as evahash64 gives.  returns the bytes used up
+static uint64_t sh9a_hash_packed(stringhash9a_t * sht, uint8_t * buf,
+                                 uint32_t * lens, int cnt, uint64_t * hashes) {
+     uint8_t * pend[SH9A_LANE_MAXLEN + 1][EVAHASH64_LANES];
+     int pidx[SH9A_LANE_MAXLEN + 1][EVAHASH64_LANES];
+     int npend[SH9A_LANE_MAXLEN + 1] = {0};
+     uint64_t out[EVAHASH64_LANES];
+     uint8_t * start = buf;
+     int i, j;
+
+     for (i = 0; i < cnt; i++) {
+          uint32_t len = lens[i];
+          if (len > SH9A_LANE_MAXLEN) {
+               hashes[i] = evahash64(buf, len, sht->hash_seed);
+          }
+          else {
+               pend[len][npend[len]] = buf;
+               pidx[len][npend[len]] = i;
+               if (++npend[len] == EVAHASH64_LANES) {
+                    evahash64_lanes(pend[len], len, sht->hash_seed, out);
+                    for (j = 0; j < EVAHASH64_LANES; j++) {
+                         hashes[pidx[len][j]] = out[j];
+                    }
+                    npend[len] = 0;
+               }
+          }
+          buf += len;
+     }
+     for (i = 0; i <= SH9A_LANE_MAXLEN; i++) {
+          for (j = 0; j < npend[i]; j++) {
+               hashes[pidx[i][j]] = evahash64(pend[i][j], i, sht->hash_seed);
+          }
+     }
+     return (uint64_t)(buf - start);
+}
+
+//look up (or with set, insert) n already hashed keys in order, working out
+// buckets SH9A_BULK_PREFETCH keys ahead so they can be prefetched.  results[i]
+// is set to 1 if key i was present.  returns the number present
+static int sh9a_posthash_batch(stringhash9a_t * sht, uint64_t * hashes, int n,
+                               uint8_t * results, int set) {
+     sh9a_index_t h1[SH9A_BULK_PREFETCH], h2[SH9A_BULK_PREFETCH];
+     uint32_t d1[SH9A_BULK_PREFETCH], d2[SH9A_BULK_PREFETCH];
+     int found = 0;
+     int i;
+
+     for (i = 0; i < n + SH9A_BULK_PREFETCH; i++) {
+          int a = i % SH9A_BULK_PREFETCH;
+          if (i >= SH9A_BULK_PREFETCH) {
+               int r = i - SH9A_BULK_PREFETCH;
+               if (set) {
+                    results[r] = (uint8_t)stringhash9a_set_posthash(sht, hashes[r],
+                                                                    h1[a], h2[a],
+                                                                    d1[a], d2[a]);
+               }
+               else {
+                    results[r] = (uint8_t)stringhash9a_check_posthash(sht, hashes[r],
+                                                                      h1[a], h2[a],
+                                                                      d1[a], d2[a]);
+               }
+               found += results[r];
+          }
+          if (i < n) {
+               sh9a_gethash3(sht, hashes[i], &h1[a], &h2[a], &d1[a], &d2[a]);
+               if (set) {
+                    sh9a_hll_add(sht, hashes[i]);
+               }
+               SH9A_PREFETCH(&sht->buckets[h1[a]]);
+               SH9A_PREFETCH(&sht->buckets[h2[a]]);
+          }
+     }
+     return found;
+}
+
+//check cnt keys packed back to back in buf, key i being lens[i] bytes long..
+// results[i] is set to 1 if key i was found.  returns the number found
+int stringhash9a_check_batch(stringhash9a_t * sht, uint8_t * buf,
+                             uint32_t * lens, int cnt, uint8_t * results) {
+     uint64_t hashes[SH9A_BATCH_CHUNK];
+     int done;
+     int found = 0;
+     for (done = 0; done < cnt; done += SH9A_BATCH_CHUNK) {
+          int n = (cnt - done < SH9A_BATCH_CHUNK) ? (cnt - done) : SH9A_BATCH_CHUNK;
+          buf += sh9a_hash_packed(sht, buf, lens + done, n, hashes);
+          found += sh9a_posthash_batch(sht, hashes, n, results + done, 0);
+     }
+     return found;
+}
+
+//set cnt keys packed back to back in buf, key i being lens[i] bytes long..
+// results[i] is set to 1 if key i was already present.  returns the number
+// already present
+int stringhash9a_set_batch(stringhash9a_t * sht, uint8_t * buf,
+                           uint32_t * lens, int cnt, uint8_t * results) {
+     uint64_t hashes[SH9A_BATCH_CHUNK];
+     int done;
+     int found = 0;
+     for (done = 0; done < cnt; done += SH9A_BATCH_CHUNK) {
+          int n = (cnt - done < SH9A_BATCH_CHUNK) ? (cnt - done) : SH9A_BATCH_CHUNK;
+          buf += sh9a_hash_packed(sht, buf, lens + done, n, hashes);
+          found += sh9a_posthash_batch(sht, hashes, n, results + done, 1);
+     }
+     return found;
+}
+
+
+
+//hashed key waiting to be placed by the bulk loader
+typedef struct _sh9a_bulk_t {
+     uint64_t hash;
+     sh9a_index_t h1, h2;
+     uint32_t d1, d2;
+} sh9a_bulk_t;
+
+//stable LSD radix sort of n records by first bucket, 8 bits per pass..
+// only the top SH9A_BULK_SORT_BITS bits of the bucket number are sorted on,
+// so records come out ordered by short runs of neighbouring buckets in at
+// most two passes.  ping-pongs between a and tmp, returns whichever holds
+// the sorted order
+static sh9a_bulk_t * sh9a_bulk_sort(sh9a_bulk_t * a, sh9a_bulk_t * tmp,
+                                    uint32_t n, uint64_t buckets) {
+     uint32_t count[256];
+     uint32_t shift = 0;
+     uint32_t i;
+
+     while ((buckets - 1) >> (shift + SH9A_BULK_SORT_BITS)) {
+          shift++;
+     }
+     for (; (shift < 64) && ((buckets - 1) >> shift); shift += 8) {
+          memset(count, 0, sizeof(count));
+          for (i = 0; i < n; i++) {
+               count[(a[i].h1 >> shift) & 0xFF]++;
+          }
+          uint32_t sum = 0;
+          for (i = 0; i < 256; i++) {
+               uint32_t c = count[i];
+               count[i] = sum;
+               sum += c;
+          }
+          for (i = 0; i < n; i++) {
+               tmp[count[(a[i].h1 >> shift) & 0xFF]++] = a[i];
+          }
+          sh9a_bulk_t * swap = a;
+          a = tmp;
+          tmp = swap;
+     }
+     return a;
+}
+
+//build a table from cnt keys packed back to back in buf, key i being
+// lens[i] bytes long.. for large key sets, much faster than calling
+// stringhash9a_set in a loop.  keys are hashed a chunk at a time, radix
+// sorted by first bucket and then placed with the same two-choice/epoch
+// rules as stringhash9a_set.  first buckets are swept in address order;
+// second buckets (the other half of the table, or the same block in blocked
+// mode) are still reached at random, but are prefetched
+// SH9A_BULK_PREFETCH keys ahead so their misses overlap.  membership
+// afterwards matches serial insertion; only which keys get dropped on an
+// overfull table can differ.  returns the number of keys already present,
+// or -1 if scratch space could not be allocated
+int stringhash9a_bulk_load(stringhash9a_t * sht, uint8_t * buf,
+                           uint32_t * lens, int cnt) {
+     uint64_t buckets = (uint64_t)sht->index_size * 2;
+     uint32_t chunk = (cnt < SH9A_BULK_CHUNK) ? (uint32_t)cnt : SH9A_BULK_CHUNK;
+     int found = 0;
+     int done = 0;
+
+     if (cnt <= 0) {
+          return 0;
+     }
+     sh9a_bulk_t * keys = (sh9a_bulk_t *)malloc(sizeof(sh9a_bulk_t) * chunk * 2);
+     if (!keys) {
+          dprint("failed malloc of stringhash9a bulk scratch");
+          return -1;
+     }
+
+     while (done < cnt) {
+          uint32_t n = ((uint32_t)(cnt - done) < chunk) ? (uint32_t)(cnt - done) : chunk;
+          uint32_t i;
+
+          //hash pass.. no table memory touched.  the sort's scratch half
+          // holds the raw hashes until they are spread into keys[]
+          uint64_t * hashes = (uint64_t *)(keys + chunk);
+          buf += sh9a_hash_packed(sht, buf, lens + done, n, hashes);
+          for (i = 0; i < n; i++) {
+               sh9a_bulk_t * k = &keys[i];
+               k->hash = hashes[i];
+               sh9a_gethash3(sht, k->hash, &k->h1, &k->h2, &k->d1, &k->d2);
+               sh9a_hll_add(sht, k->hash);
+          }
 
-     return stringhash9a_set_posthash(sht, h1, h2, d1, d2);
+          sh9a_bulk_t * sorted = sh9a_bulk_sort(keys, keys + chunk, n, buckets);
+
+          //place pass.. walk the table in bucket order, prefetching ahead
+          for (i = 0; i < n; i++) {
+               if (i + SH9A_BULK_PREFETCH < n) {
+                    SH9A_PREFETCH(&sht->buckets[sorted[i + SH9A_BULK_PREFETCH].h1]);
+                    SH9A_PREFETCH(&sht->buckets[sorted[i + SH9A_BULK_PREFETCH].h2]);
+               }
+               sh9a_bulk_t * k = &sorted[i];
+               found += stringhash9a_set_posthash(sht, k->hash, k->h1, k->h2,
+                                                  k->d1, k->d2);
+          }
+          done += n;
+     }
+     free(keys);
+     return found;
 }
 
+//set every complete record framed in buf (len bytes).. records either end
+// in '\n' (SH9A_FRAME_NEWLINE, the newline is not part of the key) or are
+// preceded by a little endian 32 bit length (SH9A_FRAME_LEN32).  for record
+// i, offs[i] and lens[i] give its key bytes within buf and results[i] is 1
+// if it was already present.  stops after max_recs records or at the first
+// incomplete one and stores the bytes used up in *consumed, so a caller
+// streaming chunks carries buf[*consumed..len) over to the next call.  with
+// SH9A_FRAME_FINAL, trailing bytes with no newline count as a last record.
+// records are set in order, but hashed a few ahead so their buckets can be
+// prefetched.  returns the number of records set
+int stringhash9a_set_framed(stringhash9a_t * sht, uint8_t * buf, uint32_t len,
+                            uint32_t framing, uint32_t * offs, uint32_t * lens,
+                            uint8_t * results, int max_recs,
+                            uint32_t * consumed) {
+     uint32_t pos = 0;
+     int n = 0;
+
+     while ((n < max_recs) && (pos < len)) {
+          uint32_t start, rlen, next;
+          if ((framing & SH9A_FRAME_MASK) == SH9A_FRAME_LEN32) {
+               if (len - pos < 4) {
+                    break;
+               }
+               rlen = (uint32_t)buf[pos] | ((uint32_t)buf[pos+1] << 8) |
+                    ((uint32_t)buf[pos+2] << 16) | ((uint32_t)buf[pos+3] << 24);
+               if (rlen > len - pos - 4) {
+                    break;
+               }
+               start = pos + 4;
+               next = start + rlen;
+          }
+          else {
+               uint8_t * nl = (uint8_t *)memchr(buf + pos, '\n', len - pos);
+               start = pos;
+               if (nl) {
+                    rlen = (uint32_t)(nl - (buf + pos));
+                    next = pos + rlen + 1;
+               }
+               else if (framing & SH9A_FRAME_FINAL) {
+                    rlen = len - pos;
+                    next = len;
+               }
+               else {
+                    break;
+               }
+          }
+          offs[n] = start;
+          lens[n] = rlen;
+          n++;
+          pos = next;
+     }
+     *consumed = pos;
 
+     sh9a_bulk_t ahead[SH9A_BULK_PREFETCH];
+     int i;
+     for (i = 0; i < n + SH9A_BULK_PREFETCH; i++) {
+          //slot i % SH9A_BULK_PREFETCH holds record i - SH9A_BULK_PREFETCH
+          // until it is set, then record i
+          sh9a_bulk_t * k = &ahead[i % SH9A_BULK_PREFETCH];
+          if (i >= SH9A_BULK_PREFETCH) {
+               results[i - SH9A_BULK_PREFETCH] =
+                    (uint8_t)stringhash9a_set_posthash(sht, k->hash, k->h1, k->h2,
+                                                       k->d1, k->d2);
+          }
+          if (i < n) {
+               k->hash = evahash64(buf + offs[i], lens[i], sht->hash_seed);
+               sh9a_gethash3(sht, k->hash, &k->h1, &k->h2, &k->d1, &k->d2);
+               sh9a_hll_add(sht, k->hash);
+               SH9A_PREFETCH(&sht->buckets[k->h1]);
+               SH9A_PREFETCH(&sht->buckets[k->h2]);
+          }
+     }
+     return n;
+}
 
 //move mru item to front.. for lower 16 items in a bucket
 void sh9a_sort_lru_lower_half(uint32_t * d, uint8_t mru) {
@@ -793,9 +1938,11 @@ void sh9a_delete_lru(uint32_t * d, uint8_t item) {
      if (item < 16) {
           for (i = item; i < 15; i++) {
                d[i] &= SH9A_LEFTOVER_MASK;
-               d[i] = d[i+1] & SH9A_DIGEST_MASK;
+               d[i] |= d[i+1] & SH9A_DIGEST_MASK;
           }
-          d[15] = ((d[0] & SH9A_LEFTOVER_MASK)<<8) + 
+          //keep the bucket epoch in the low byte of d[15]
+          d[15] &= SH9A_LEFTOVER_MASK;
+          d[15] |= ((d[0] & SH9A_LEFTOVER_MASK)<<8) + 
                ((d[1] & SH9A_LEFTOVER_MASK)<<16) +
                ((d[2] & SH9A_LEFTOVER_MASK)<<24);
 
@@ -854,7 +2001,7 @@ int sh9a_delete_bucket(sh9a_bucket_t * bucket,
                sh9a_delete_lru(bucket->digest, i);
                return 1;
           }
-          sh9a_build_leftover(i, leftover, digest);
+          sh9a_build_leftover(i, leftover, dp[i]);
      }
      for (i = 0; i < 5; i++) {
           if (digest == leftover[i]) {
@@ -867,39 +2014,634 @@ int sh9a_delete_bucket(sh9a_bucket_t * bucket,
 }
 
 
+//verify mode delete.. removes the exact entry and its fingerprint
+int sh9a_verify_delete(stringhash9a_t * sht, sh9a_index_t h,
+                       uint32_t digest, uint64_t hash) {
+     int pos = sh9a_verify_find(sht, h, digest, hash);
+     if (pos < 0) {
+          return 0;
+     }
+     uint64_t * fp = sh9a_verify_fp(sht, h);
+     sh9a_delete_lru(sht->buckets[h].digest, pos);
+     memmove(&fp[pos], &fp[pos+1],
+             (SH9A_VERIFY_SLOTS - 1 - pos) * sizeof(uint64_t));
+     fp[SH9A_VERIFY_SLOTS - 1] = 0;
+     return 1;
+}
+
+static int sh9a_delete_table(stringhash9a_t * sht, uint64_t hash,
+                             sh9a_index_t h1, sh9a_index_t h2,
+                             uint32_t d1, uint32_t d2) {
+     if (sht->front) {
+          sh9a_front_remove(sht, hash, h1, h2);
+     }
+     if (sht->verify) {
+          if (sh9a_verify_delete(sht, h1, d1, hash) ||
+              sh9a_verify_delete(sht, h2, d2, hash)) {
+               return 1;
+          }
+     }
+     //lookup in digest.. location1
+     else if (sh9a_delete_bucket(sh9a_get_bucket(sht, h1), d1) ||
+              sh9a_delete_bucket(sh9a_get_bucket(sht, h2), d2)) {
+          return 1;
+     }
+
+     if (sht->stash_cnt) {
+          return sh9a_stash_lookup(sht, hash, h1, h2, d1, d2, 1);
+     }
+
+     return 0;
+}
+
+int stringhash9a_delete_posthash(stringhash9a_t * sht, uint64_t hash,
+                                 sh9a_index_t h1, sh9a_index_t h2,
+                                 uint32_t d1, uint32_t d2) {
+     int found = sh9a_delete_table(sht, hash, h1, h2, d1, d2);
+     SH9A_TRACE_OP(sht, SH9A_TRACE_DELETE, hash, found);
+     return found;
+}
+
 int stringhash9a_delete(stringhash9a_t * sht,
                                       void * key, int keylen) {
 
-     uint32_t h1, h2;
+     sh9a_index_t h1, h2;
      uint32_t d1, d2;
+     uint64_t hash;
 
-     sh9a_gethash(sht, (uint8_t*)key, keylen, &h1, &h2, &d1, &d2);
+     sh9a_gethash2(sht, (uint8_t*)key, keylen, &h1, &h2, &d1, &d2, &hash);
 
-     //lookup in digest.. location1
-     if (sh9a_delete_bucket(&sht->buckets[h1], d1)) {
+     return stringhash9a_delete_posthash(sht, hash, h1, h2, d1, d2);
+}
+
+//delete using a key hash computed earlier
+int stringhash9a_delete_hash(stringhash9a_t * sht, uint64_t hash) {
+
+     sh9a_index_t h1, h2;
+     uint32_t d1, d2;
+
+     sh9a_gethash3(sht, hash, &h1, &h2, &d1, &d2);
+
+     return stringhash9a_delete_posthash(sht, hash, h1, h2, d1, d2);
+}
+
+void stringhash9a_flush(stringhash9a_t * sht) {
+     SH9A_TRACE_OP(sht, SH9A_TRACE_FLUSH, 0, 0);
+     sht->epoch = 1;
+     sht->stash_cnt = 0;
+     if (sht->front) {
+          memset(sht->front_epoch, 0, sht->front_mask + 1);
+     }
+     if (sht->hll) {
+          memset(sht->hll, 0, (size_t)1 << sht->hll_bits);
+     }
+     if (sht->gen) {
+          //lazy flush - bump the generation, stale buckets get cleared when
+          // next touched or by stringhash9a_flush_step
+          uint64_t total = (uint64_t)sht->index_size * 2;
+          sht->generation++;
+          sht->sweep_pos = 0;
+          //once every 256 flushes the generation wraps.. tags left by older
+          // flushes or sweeps could now look current - so clear for real
+          if (sht->generation) {
+               return;
+          }
+          memset(sht->gen, 0, total);
+     }
+     memset(sht->buckets, 0, sizeof(sh9a_bucket_t) * (uint64_t)sht->index_size * 2);
+     //stash lines are not swept, so with lazy flush this is also where they
+     // and their tags get reset when the generation wraps
+     if (sht->stash) {
+          memset(sht->stash, 0, sizeof(sh9a_stash_t) * (uint64_t)sht->stash_lines);
+          memset(sht->stash_gen, 0, sht->stash_lines);
+     }
+     //fingerprints only count next to a matching digest, so the lazy path
+     // above can leave them behind.. here they go with the buckets
+     if (sht->verify) {
+          memset(sht->verify, 0, sizeof(uint64_t) * SH9A_VERIFY_SLOTS *
+                 (uint64_t)sht->index_size * 2);
+     }
+}
+
+//allocate per-bucket generation tags so that stringhash9a_flush runs in
+// constant time instead of zeroing the whole bucket array.. costs one byte
+// per bucket.  returns 0 on allocation failure
+int stringhash9a_enable_lazy_flush(stringhash9a_t * sht) {
+     if (sht->gen) {
+          return 1;
+     }
+     uint64_t total = (uint64_t)sht->index_size * 2;
+     sht->gen = (uint8_t *)calloc(total, sizeof(uint8_t));
+     if (!sht->gen) {
+          dprint("failed calloc of stringhash9a generation tags");
+          return 0;
+     }
+     sht->generation = 0;
+     sht->sweep_pos = total;
+     sht->mem_used += total * sizeof(uint8_t);
+     return 1;
+}
+
+//add an overflow stash of one cache line per SH9A_STASH_GROUP buckets..
+// entries pushed out of full buckets wait there and are only probed when
+// both buckets miss, cutting drops under bursty load.  returns 0 on
+// allocation failure
+int stringhash9a_enable_stash(stringhash9a_t * sht) {
+     if (sht->stash) {
+          return 1;
+     }
+     uint64_t total = (uint64_t)sht->index_size * 2;
+     sht->stash_lines = (total + SH9A_STASH_GROUP - 1) / SH9A_STASH_GROUP;
+     sht->stash = (sh9a_stash_t *)calloc(sht->stash_lines, sizeof(sh9a_stash_t));
+     sht->stash_gen = (uint8_t *)calloc(sht->stash_lines, sizeof(uint8_t));
+     if (!sht->stash || !sht->stash_gen) {
+          dprint("failed calloc of stringhash9a stash");
+          free(sht->stash);
+          free(sht->stash_gen);
+          sht->stash = NULL;
+          sht->stash_gen = NULL;
+          return 0;
+     }
+     if (sht->verify) {
+          sht->stash_fp = (uint64_t *)calloc((uint64_t)sht->stash_lines *
+                                             SH9A_STASH_DEPTH, sizeof(uint64_t));
+          if (!sht->stash_fp) {
+               dprint("failed calloc of stringhash9a stash fingerprints");
+               free(sht->stash);
+               free(sht->stash_gen);
+               sht->stash = NULL;
+               sht->stash_gen = NULL;
+               return 0;
+          }
+          sht->mem_used += (uint64_t)sht->stash_lines * SH9A_STASH_DEPTH *
+               sizeof(uint64_t);
+     }
+     //tag lines with the current generation so they read as clean
+     memset(sht->stash_gen, sht->generation, sht->stash_lines);
+     sht->mem_used += (uint64_t)sht->stash_lines *
+          (sizeof(sh9a_stash_t) + sizeof(uint8_t));
+     return 1;
+}
+
+//attach a hyperloglog distinct key estimator with 2^bits registers.. it is
+// updated by every set from the hash the table computes anyway, and reset by
+// stringhash9a_flush.  returns 0 on bad bits or allocation failure
+int stringhash9a_enable_hll(stringhash9a_t * sht, uint32_t bits) {
+     if ((bits < SH9A_HLL_MIN_BITS) || (bits > SH9A_HLL_MAX_BITS)) {
+          dprint("stringhash9a hll bits must be %d to %d",
+                 SH9A_HLL_MIN_BITS, SH9A_HLL_MAX_BITS);
+          return 0;
+     }
+     if (sht->hll) {
+          return (sht->hll_bits == bits);
+     }
+     sht->hll = (uint8_t *)calloc((size_t)1 << bits, sizeof(uint8_t));
+     if (!sht->hll) {
+          dprint("failed calloc of stringhash9a hll registers");
+          return 0;
+     }
+     sht->hll_bits = bits;
+     sht->mem_used += (uint64_t)1 << bits;
+     return 1;
+}
+
+//put a small direct-mapped cache of 2^bits recently hit key hashes in front
+// of the table.. a key found in the table lands in it, and repeat lookups
+// are then answered without probing or rewriting buckets.  off by default..
+// it pays off only under heavily skewed, lookup heavy traffic (see sh9bench
+// front) and is overhead otherwise.  bits of 10 to 14 keep it within L1/L2.
+// entries are dropped on delete, flush and when the key is pushed out of its
+// bucket, so the cache never answers for a key the table no longer holds.
+// returns 0 on allocation failure
+int stringhash9a_enable_front(stringhash9a_t * sht, uint32_t bits) {
+     if (bits < SH9A_FRONT_MIN_BITS) {
+          bits = SH9A_FRONT_MIN_BITS;
+     }
+     if (bits > SH9A_FRONT_MAX_BITS) {
+          bits = SH9A_FRONT_MAX_BITS;
+     }
+     if (sht->front) {
+          return 1;
+     }
+     sht->front = (uint64_t *)calloc((size_t)1 << bits, sizeof(uint64_t));
+     sht->front_epoch = (uint8_t *)calloc((size_t)1 << bits, sizeof(uint8_t));
+     if (!sht->front || !sht->front_epoch) {
+          dprint("failed calloc of stringhash9a front cache");
+          free(sht->front);
+          free(sht->front_epoch);
+          sht->front = NULL;
+          sht->front_epoch = NULL;
+          return 0;
+     }
+     sht->front_mask = ((uint64_t)1 << bits) - 1;
+     sht->mem_used += (sizeof(uint64_t) + sizeof(uint8_t)) << bits;
+     return 1;
+}
+
+//keep the full 64 bit key hash next to every digest, in a parallel arena in
+// the same bucket and slot order, so a digest match is confirmed in memory
+// and false positives go away (short of a full 64 bit hash collision).  costs
+// SH9A_VERIFY_SLOTS * 8 bytes per 64 byte bucket - see mem_used.  enable it
+// before the table is used, entries set earlier have no fingerprint and
+// will not be found.  returns 0 on allocation failure
+int stringhash9a_enable_verify(stringhash9a_t * sht) {
+     if (sht->verify) {
           return 1;
      }
+     uint64_t total = (uint64_t)sht->index_size * 2;
+     sht->verify = (uint64_t *)calloc(total * SH9A_VERIFY_SLOTS, sizeof(uint64_t));
+     if (!sht->verify) {
+          dprint("failed calloc of stringhash9a verify arena");
+          return 0;
+     }
+     uint64_t mem = total * SH9A_VERIFY_SLOTS * sizeof(uint64_t);
+     if (sht->stash) {
+          sht->stash_fp = (uint64_t *)calloc((uint64_t)sht->stash_lines *
+                                             SH9A_STASH_DEPTH, sizeof(uint64_t));
+          if (!sht->stash_fp) {
+               dprint("failed calloc of stringhash9a stash fingerprints");
+               free(sht->verify);
+               sht->verify = NULL;
+               return 0;
+          }
+          mem += (uint64_t)sht->stash_lines * SH9A_STASH_DEPTH * sizeof(uint64_t);
+     }
+     sht->mem_used += mem;
+     return 1;
+}
+
+//natural log for the small range correction, without pulling in libm
+static double sh9a_ln(double x) {
+     int k = 0;
+     while (x >= 2.0) {
+          x *= 0.5;
+          k++;
+     }
+     //ln(x) = 2 atanh((x-1)/(x+1)), quick to converge for x in [1,2)
+     double t = (x - 1.0) / (x + 1.0);
+     double t2 = t * t;
+     double term = t;
+     double sum = 0;
+     int i;
+     for (i = 1; i < 24; i += 2) {
+          sum += term / i;
+          term *= t2;
+     }
+     return k * 0.69314718055994531 + 2.0 * sum;
+}
+
+//estimated number of distinct keys set since the last flush, -1 if the
+// estimator is not enabled
+double stringhash9a_hll_estimate(stringhash9a_t * sht) {
+     if (!sht->hll) {
+          return -1;
+     }
+     uint32_t m = 1U << sht->hll_bits;
+     uint32_t zeros = 0;
+     double sum = 0;
+     uint32_t i;
+     for (i = 0; i < m; i++) {
+          sum += 1.0 / (double)(1ULL << sht->hll[i]);
+          zeros += sht->hll[i] ? 0 : 1;
+     }
+
+     double alpha;
+     switch (m) {
+     case 16:
+          alpha = 0.673;
+          break;
+     case 32:
+          alpha = 0.697;
+          break;
+     case 64:
+          alpha = 0.709;
+          break;
+     default:
+          alpha = 0.7213 / (1.0 + 1.079 / m);
+     }
+     double est = alpha * m * m / sum;
+
+     //linear counting while many registers are still empty
+     if ((est <= 2.5 * m) && zeros) {
+          est = m * sh9a_ln((double)m / zeros);
+     }
+     return est;
+}
 
-     if (sh9a_delete_bucket(&sht->buckets[h2], d2)) {
+//fold src's estimator into dst, giving the distinct count of their union..
+// both need the same register count and hash seed (see
+// stringhash9a_create_seed), otherwise returns 0
+int stringhash9a_hll_merge(stringhash9a_t * dst, stringhash9a_t * src) {
+     if (!dst->hll || !src->hll || (dst->hll_bits != src->hll_bits) ||
+         (dst->hash_seed != src->hash_seed)) {
+          return 0;
+     }
+     uint32_t i;
+     for (i = 0; i < (1U << dst->hll_bits); i++) {
+          if (src->hll[i] > dst->hll[i]) {
+               dst->hll[i] = src->hll[i];
+          }
+     }
+     return 1;
+}
+
+//clear up to cnt buckets left stale by a lazy flush, picking up where the
+// last call stopped.. returns 1 once the whole table has been swept.  Call it
+// between operations (idle time, after a window boundary) to spread the
+// zeroing out - it is not safe to run concurrently with other calls
+int stringhash9a_flush_step(stringhash9a_t * sht, uint32_t cnt) {
+     if (!sht->gen) {
           return 1;
      }
+     uint64_t total = (uint64_t)sht->index_size * 2;
+     uint64_t end = sht->sweep_pos + cnt;
+     if (end > total) {
+          end = total;
+     }
+     for (; sht->sweep_pos < end; sht->sweep_pos++) {
+          sh9a_get_bucket(sht, (sh9a_index_t)sht->sweep_pos);
+     }
+     return (sht->sweep_pos >= total);
+}
+
+//record every call on this table to a trace file at path, for replay with
+// sh9replay.  open it right after create so a replay, which starts from an
+// empty table, sees the same state.  builds without -DSH9A_TRACE return 0
+int stringhash9a_trace_open(stringhash9a_t * sht, const char * path) {
+#ifdef SH9A_TRACE
+     sh9a_trace_header_t hdr;
+     sh9a_trace_t * tr;
+
+     stringhash9a_trace_close(sht);
+     tr = (sh9a_trace_t *)calloc(1, sizeof(sh9a_trace_t));
+     if (!tr) {
+          dprint("failed calloc of stringhash9a trace");
+          return 0;
+     }
+     tr->fp = fopen(path, "wb");
+     if (!tr->fp) {
+          dprint("unable to open stringhash9a trace %s", path);
+          free(tr);
+          return 0;
+     }
 
+     memset(&hdr, 0, sizeof(hdr));
+     hdr.magic = SH9A_TRACE_MAGIC;
+     hdr.version = SH9A_TRACE_VERSION;
+     hdr.rec_size = sizeof(sh9a_trace_rec_t);
+     hdr.hash_seed = sht->hash_seed;
+     hdr.mode = sht->mode;
+     hdr.index_size = sht->index_size;
+     hdr.features = (sht->stash ? SH9A_TRACE_F_STASH : 0) |
+          (sht->verify ? SH9A_TRACE_F_VERIFY : 0) |
+          (sht->front ? SH9A_TRACE_F_FRONT : 0) |
+          (sht->gen ? SH9A_TRACE_F_LAZY : 0) |
+          (sht->hll ? SH9A_TRACE_F_HLL : 0);
+     hdr.front_bits = sht->front ? sh9a_uint64_log2(sht->front_mask + 1) : 0;
+     hdr.hll_bits = sht->hll ? sht->hll_bits : 0;
+     if (fwrite(&hdr, sizeof(hdr), 1, tr->fp) != 1) {
+          dprint("stringhash9a trace write failed");
+          fclose(tr->fp);
+          free(tr);
+          return 0;
+     }
+     tr->last_ns = sh9a_trace_now();
+     sht->trace = tr;
+     return 1;
+#else
+     (void)sht;
+     (void)path;
+     dprint("stringhash9a built without SH9A_TRACE, not tracing to %s", path);
      return 0;
+#endif
 }
 
-void stringhash9a_flush(stringhash9a_t * sht) {
-     memset(sht->buckets, 0, sizeof(sh9a_bucket_t) * (uint64_t)sht->index_size * 2);
-     sht->epoch = 1;
+//write out buffered records and close the trace.. also done by destroy
+void stringhash9a_trace_close(stringhash9a_t * sht) {
+#ifdef SH9A_TRACE
+     sh9a_trace_t * tr = sht->trace;
+     if (!tr) {
+          return;
+     }
+     sh9a_trace_write(tr);
+     fclose(tr->fp);
+     dprint("stringhash9a trace closed after %"PRIu64" records", tr->cnt);
+     free(tr);
+     sht->trace = NULL;
+#else
+     (void)sht;
+#endif
 }
 
 void stringhash9a_destroy(stringhash9a_t * sht) {
+     stringhash9a_trace_close(sht);
 
      uint64_t expire_cnt = stringhash9a_drop_cnt(sht);
      if (expire_cnt) {
           dprint("sh9a table expire cnt %"PRIu64, expire_cnt);
      }
+     free(sht->hll);
+     free(sht->front);
+     free(sht->front_epoch);
+     free(sht->verify);
+     free(sht->stash_fp);
+     free(sht->stash);
+     free(sht->stash_gen);
+     free(sht->gen);
      free(sht->buckets);
      free(sht);
 }
 
+//create a sliding window of two tables, each holding max_records.. both
+// generations are allocated up front and share a seed so a key is hashed
+// once, and rotation is a pointer swap plus a lazy flush
+stringhash9a_window_t * stringhash9a_window_create(size_t max_records) {
+     stringhash9a_window_t * shw;
+     shw = (stringhash9a_window_t *)calloc(1, sizeof(stringhash9a_window_t));
+     if (!shw) {
+          dprint("failed calloc of stringhash9a window");
+          return NULL;
+     }
+     uint32_t seed = sh9a_new_seed();
+     shw->cur = stringhash9a_create_seed(max_records, seed);
+     shw->prev = stringhash9a_create_seed(max_records, seed);
+     if (!shw->cur || !shw->prev ||
+         !stringhash9a_enable_lazy_flush(shw->cur) ||
+         !stringhash9a_enable_lazy_flush(shw->prev)) {
+          dprint("stringhash9a_window_create failed");
+          stringhash9a_window_destroy(shw);
+          return NULL;
+     }
+     return shw;
+}
+
+//both generations share seed and geometry, so one hash gives the bucket
+// addresses in each.. prefetch all four before either table is probed, so
+// the miss on prev overlaps the one on cur
+static inline void sh9a_window_gethash(stringhash9a_window_t * shw,
+                                       void * key, int keylen,
+                                       sh9a_index_t * h1, sh9a_index_t * h2,
+                                       uint32_t * d1, uint32_t * d2,
+                                       uint64_t * hash) {
+     sh9a_gethash2(shw->cur, (uint8_t*)key, keylen, h1, h2, d1, d2, hash);
+     SH9A_PREFETCH(&shw->cur->buckets[*h1]);
+     SH9A_PREFETCH(&shw->cur->buckets[*h2]);
+     SH9A_PREFETCH(&shw->prev->buckets[*h1]);
+     SH9A_PREFETCH(&shw->prev->buckets[*h2]);
+}
+
+//return 1 if key was seen in either generation
+int stringhash9a_window_check(stringhash9a_window_t * shw,
+                              void * key, int keylen) {
+     sh9a_index_t h1, h2;
+     uint32_t d1, d2;
+     uint64_t hash;
+
+     sh9a_window_gethash(shw, key, keylen, &h1, &h2, &d1, &d2, &hash);
+
+     return stringhash9a_check_posthash(shw->cur, hash, h1, h2, d1, d2) ||
+          stringhash9a_check_posthash(shw->prev, hash, h1, h2, d1, d2);
+}
+
+//return 1 if key was seen in either generation.. the key is always left in
+// the current generation so it survives the next rotation
+int stringhash9a_window_set(stringhash9a_window_t * shw,
+                            void * key, int keylen) {
+     sh9a_index_t h1, h2;
+     uint32_t d1, d2;
+     uint64_t hash;
+
+     sh9a_window_gethash(shw, key, keylen, &h1, &h2, &d1, &d2, &hash);
+     sh9a_hll_add(shw->cur, hash);
+
+     if (stringhash9a_set_posthash(shw->cur, hash, h1, h2, d1, d2)) {
+          return 1;
+     }
+     return stringhash9a_check_posthash(shw->prev, hash, h1, h2, d1, d2);
+}
+
+//start a new window.. current becomes previous, the old previous is recycled
+void stringhash9a_window_rotate(stringhash9a_window_t * shw) {
+     stringhash9a_t * sht = shw->prev;
+     shw->prev = shw->cur;
+     shw->cur = sht;
+     stringhash9a_flush(shw->cur);
+}
+
+void stringhash9a_window_destroy(stringhash9a_window_t * shw) {
+     if (shw->cur) {
+          stringhash9a_destroy(shw->cur);
+     }
+     if (shw->prev) {
+          stringhash9a_destroy(shw->prev);
+     }
+     free(shw);
+}
+
+stringhash9a_group_t * stringhash9a_group_create(void) {
+     stringhash9a_group_t * shg;
+     shg = (stringhash9a_group_t *)calloc(1, sizeof(stringhash9a_group_t));
+     if (!shg) {
+          dprint("failed calloc of stringhash9a group");
+          return NULL;
+     }
+     shg->hash_seed = sh9a_new_seed();
+     return shg;
+}
+
+//add a member table sized for max_records.. returns its bit position in
+// group results or -1 on failure
+int stringhash9a_group_add(stringhash9a_group_t * shg, size_t max_records) {
+     if (shg->cnt >= SH9A_GROUP_MAX) {
+          dprint("stringhash9a group is full");
+          return -1;
+     }
+     stringhash9a_t * sht = stringhash9a_create_seed(max_records, shg->hash_seed);
+     if (!sht) {
+          return -1;
+     }
+     shg->tables[shg->cnt] = sht;
+     return (int)shg->cnt++;
+}
+
+//derive indexes for every selected member from a single hash and prefetch
+// all candidate buckets before any of them is probed
+static inline uint64_t sh9a_group_gethash(stringhash9a_group_t * shg,
+                                          void * key, int keylen,
+                                          uint64_t members,
+                                          uint64_t * phash,
+                                          sh9a_index_t * h1, sh9a_index_t * h2,
+                                          uint32_t * d1, uint32_t * d2) {
+     uint64_t hash = evahash64((uint8_t*)key, keylen, shg->hash_seed);
+     uint32_t i;
+
+     *phash = hash;
+     if (shg->cnt < SH9A_GROUP_MAX) {
+          members &= (1ULL << shg->cnt) - 1;
+     }
+     for (i = 0; i < shg->cnt; i++) {
+          if (!(members & (1ULL << i))) {
+               continue;
+          }
+          stringhash9a_t * sht = shg->tables[i];
+          sh9a_gethash3(sht, hash, &h1[i], &h2[i], &d1[i], &d2[i]);
+          SH9A_PREFETCH(&sht->buckets[h1[i]]);
+          SH9A_PREFETCH(&sht->buckets[h2[i]]);
+     }
+     return members;
+}
+
+//check key against the member tables selected by the members bitmask..
+// returns a bitmask of the members where key was found
+uint64_t stringhash9a_group_check(stringhash9a_group_t * shg,
+                                  void * key, int keylen, uint64_t members) {
+     sh9a_index_t h1[SH9A_GROUP_MAX], h2[SH9A_GROUP_MAX];
+     uint32_t d1[SH9A_GROUP_MAX], d2[SH9A_GROUP_MAX];
+     uint64_t found = 0;
+     uint64_t hash;
+     uint32_t i;
+
+     members = sh9a_group_gethash(shg, key, keylen, members, &hash,
+                                  h1, h2, d1, d2);
+     for (i = 0; i < shg->cnt; i++) {
+          if ((members & (1ULL << i)) &&
+              stringhash9a_check_posthash(shg->tables[i], hash, h1[i], h2[i],
+                                          d1[i], d2[i])) {
+               found |= 1ULL << i;
+          }
+     }
+     return found;
+}
 
+//set key in the member tables selected by the members bitmask.. returns a
+// bitmask of the members where key was already present
+uint64_t stringhash9a_group_set(stringhash9a_group_t * shg,
+                                void * key, int keylen, uint64_t members) {
+     sh9a_index_t h1[SH9A_GROUP_MAX], h2[SH9A_GROUP_MAX];
+     uint32_t d1[SH9A_GROUP_MAX], d2[SH9A_GROUP_MAX];
+     uint64_t found = 0;
+     uint64_t hash;
+     uint32_t i;
+
+     members = sh9a_group_gethash(shg, key, keylen, members, &hash,
+                                  h1, h2, d1, d2);
+     for (i = 0; i < shg->cnt; i++) {
+          if (!(members & (1ULL << i))) {
+               continue;
+          }
+          sh9a_hll_add(shg->tables[i], hash);
+          if (stringhash9a_set_posthash(shg->tables[i], hash, h1[i], h2[i],
+                                        d1[i], d2[i])) {
+               found |= 1ULL << i;
+          }
+     }
+     return found;
+}
+
+void stringhash9a_group_destroy(stringhash9a_group_t * shg) {
+     uint32_t i;
+     for (i = 0; i < shg->cnt; i++) {
+          stringhash9a_destroy(shg->tables[i]);
+     }
+     free(shg);
+}
@@ -33,6 +33,15 @@ SOFTWARE.
 #include "evahash64.h"
 #include "dprint.h"
 
+//bucket index.. 64 bit wherever pointers are (native hosts, wasm memory64)
+// so a table can go past 4G buckets, 32 bit on wasm32 where it cannot
+#if UINTPTR_MAX > 0xFFFFFFFFU
+#define SH9A_INDEX64 1
+typedef uint64_t sh9a_index_t;
+#else
+typedef uint32_t sh9a_index_t;
+#endif
+
 //macros
 #define SHT9A_ID  "STRINGHASH9A"
 #define SHT5_ID   "STRINGHASH5 "
@@ -54,34 +63,210 @@ SOFTWARE.
 #endif
 #endif
 
+//placement modes, chosen at create time
+#define SH9A_MODE_CUCKOO 0x1 //partial-key cuckoo - entries can move to their other bucket
+#define SH9A_MODE_BLOCKED 0x2 //both candidate buckets in the same block
+#define SH9A_CUCKOO_KICKS 16 //max entries displaced by one insert
+
+//buckets per block in blocked mode.. 64 fills a 4KB page, 32768 a 2MB huge
+// page.  the first half of a block holds h1 candidates, the second half h2
+#ifndef SH9A_BLOCK_BUCKETS
+#define SH9A_BLOCK_BUCKETS 64
+#endif
+
+//cardinality sidecar register counts are 2^bits
+#define SH9A_HLL_MIN_BITS 4
+#define SH9A_HLL_MAX_BITS 16
+
+//stringhash9a_set_get_age.. each bucket sees an insert about every 32
+// epochs (index_size/16 inserts per epoch over 2*index_size buckets), so an
+// entry's LRU position stands in for that many epochs.  ages saturate
+#define SH9A_AGE_POS_EPOCHS 32
+#define SH9A_AGE_MAX 255
+
+//record framing for stringhash9a_set_framed
+#define SH9A_FRAME_NEWLINE 0
+#define SH9A_FRAME_LEN32 1
+#define SH9A_FRAME_MASK 0xFF
+#define SH9A_FRAME_FINAL 0x100 //last call of a stream - no newline needed on the last record
+
+#define SH9A_BATCH_CHUNK 256 //keys hashed ahead per step of set/check_batch
+#define SH9A_LANE_MAXLEN 16  //keys up to this long are hashed several at a time
+
+#define SH9A_BULK_CHUNK (1<<18) //keys hashed and sorted at a time by bulk load
+#define SH9A_BULK_PREFETCH 8     //buckets prefetched ahead while placing
+#define SH9A_BULK_SORT_BITS 16   //top bucket number bits bulk load sorts on
+
+//hot key front cache sizes, as 2^bits entries of 9 bytes.. an entry is
+// trusted for SH9A_FRONT_MAX_AGE epochs after it was filled
+#define SH9A_FRONT_MIN_BITS 6
+#define SH9A_FRONT_MAX_BITS 20
+#define SH9A_FRONT_MAX_AGE 16
+
+//verify mode keeps one full 64 bit key hash per bucket slot
+#define SH9A_VERIFY_SLOTS 21
+
+//operation trace files, written by builds with -DSH9A_TRACE and read back by
+// sh9replay.  one sh9a_trace_header_t, then one sh9a_trace_rec_t per call,
+// in host byte order (little endian on x86, arm and wasm)
+#define SH9A_TRACE_MAGIC 0x54413953U //"S9AT"
+#define SH9A_TRACE_VERSION 1
+#define SH9A_TRACE_SET 1
+#define SH9A_TRACE_CHECK 2
+#define SH9A_TRACE_AGE 3     //check_get_age
+#define SH9A_TRACE_DELETE 4
+#define SH9A_TRACE_FLUSH 5
+#define SH9A_TRACE_SET_AGE 6 //set_get_age
+#define SH9A_TRACE_F_STASH 0x1  //options enabled on the recorded table
+#define SH9A_TRACE_F_VERIFY 0x2
+#define SH9A_TRACE_F_FRONT 0x4
+#define SH9A_TRACE_F_LAZY 0x8
+#define SH9A_TRACE_F_HLL 0x10
+
+#define SH9A_STASH_DEPTH 8  //spilled entries per stash line
+#define SH9A_STASH_GROUP 64 //buckets sharing a stash line
+
 //28 bits of digest, 4 bits of pointer to data
 //items in list sorted LRU
 typedef struct _sh9a_bucket_t {
      uint32_t digest[SH9A_DEPTH];
 } sh9a_bucket_t;
 
+//overflow stash line.. holds entries evicted from full buckets, the bucket
+// index they came from (low 32 bits, the line covers the rest) and their
+// digest with the stash epoch in the low byte
+typedef struct _sh9a_stash_t {
+     uint32_t h[SH9A_STASH_DEPTH];
+     uint32_t digest[SH9A_STASH_DEPTH];
+} sh9a_stash_t;
+
+typedef struct _sh9a_trace_header_t {
+     uint32_t magic;
+     uint16_t version;
+     uint16_t rec_size;    //sizeof(sh9a_trace_rec_t)
+     uint32_t hash_seed;
+     uint32_t mode;        //SH9A_MODE_* placement
+     uint64_t index_size;
+     uint32_t features;    //SH9A_TRACE_F_*
+     uint16_t front_bits;
+     uint16_t hll_bits;
+} sh9a_trace_header_t;
+
+typedef struct _sh9a_trace_rec_t {
+     uint64_t hash;        //64 bit key hash, 0 for a flush
+     uint32_t dt;          //ns since the previous record, saturating
+     uint8_t op;           //SH9A_TRACE_*
+     uint8_t flags;
+     int16_t result;       //what the call returned.. -1 to SH9A_AGE_MAX for age probes
+} sh9a_trace_rec_t;
+
+typedef struct _sh9a_trace_t sh9a_trace_t;
+
 typedef struct _stringhash9a_t {
      sh9a_bucket_t * buckets;
-     uint32_t max_records;
+     uint64_t max_records;
      uint64_t mem_used;
      uint32_t ibits;
-     uint32_t index_size;
+     uint64_t index_size;  //buckets in each of the 2 tables
      uint32_t hash_seed;
      uint64_t drops;
      uint8_t epoch;
-     uint32_t insert_cnt;
-     uint32_t max_insert_cnt;
+     uint64_t insert_cnt;
+     uint64_t max_insert_cnt;
      uint64_t mask_index;
-     uint32_t table_bit;
+     uint64_t table_bit;
+     uint8_t * gen;       //per-bucket generation tags, NULL unless lazy flush is enabled
+     uint8_t generation;
+     uint64_t sweep_pos;
+     sh9a_stash_t * stash; //overflow stash, NULL unless enabled
+     uint8_t * stash_gen;
+     uint64_t stash_lines;
+     uint64_t stash_cnt;   //entries spilled since the last flush
+     uint64_t stash_hits;
+     uint32_t mode;
+     uint64_t kicks;       //entries moved to their other bucket in cuckoo mode
+     uint8_t * hll;        //hyperloglog registers, NULL unless enabled
+     uint32_t hll_bits;
+     uint64_t * verify;    //per-slot key hashes, NULL unless verify mode is enabled
+     uint64_t * stash_fp;
+     uint64_t verify_rejects; //digest matches turned down by verification
+     uint64_t * front;     //hot key cache, NULL unless enabled
+     uint8_t * front_epoch; //epoch each front entry was filled in, 0 if empty
+     uint64_t front_mask;
+     uint64_t front_lookups;
+     uint64_t front_hits;
+     sh9a_trace_t * trace; //operation recorder, NULL unless a trace is open
 } stringhash9a_t;
 
+//one piece of a key that is split over several buffers
+typedef struct _sh9a_segment_t {
+     void * key;
+     uint32_t keylen;
+} sh9a_segment_t;
+
+//two generations of the same geometry and seed for "seen within the last
+// window" checks.. a key is hashed once and probed in both
+typedef struct _stringhash9a_window_t {
+     stringhash9a_t * cur;
+     stringhash9a_t * prev;
+} stringhash9a_window_t;
+
+//up to 64 tables sharing a seed.. a key is hashed once for all members and
+// results come back as a bitmask indexed by member
+#define SH9A_GROUP_MAX 64
+typedef struct _stringhash9a_group_t {
+     stringhash9a_t * tables[SH9A_GROUP_MAX];
+     uint32_t cnt;
+     uint32_t hash_seed;
+} stringhash9a_group_t;
+
 //prototypes
-stringhash9a_t * stringhash9a_create(uint32_t);
+stringhash9a_t * stringhash9a_create(size_t);
+stringhash9a_t * stringhash9a_create_records(size_t);
+stringhash9a_t * stringhash9a_create_bytes(uint64_t);
+stringhash9a_t * stringhash9a_create_seed(size_t, uint32_t);
+stringhash9a_t * stringhash9a_create_mode(size_t, uint32_t);
 int stringhash9a_check(stringhash9a_t *, void *, int);
 uint64_t stringhash9a_drop_cnt(stringhash9a_t *);
 int stringhash9a_set(stringhash9a_t *, void *, int);
 int stringhash9a_delete(stringhash9a_t *, void *, int);
+int stringhash9a_check_hash(stringhash9a_t *, uint64_t);
+int stringhash9a_set_hash(stringhash9a_t *, uint64_t);
+int stringhash9a_delete_hash(stringhash9a_t *, uint64_t);
+int stringhash9a_check_get_age_hash(stringhash9a_t *, uint64_t);
+int stringhash9a_set_get_age_hash(stringhash9a_t *, uint64_t);
+int stringhash9a_check_segments(stringhash9a_t *, sh9a_segment_t *, int);
+int stringhash9a_set_segments(stringhash9a_t *, sh9a_segment_t *, int);
+int stringhash9a_check_batch(stringhash9a_t *, uint8_t *, uint32_t *, int, uint8_t *);
+int stringhash9a_set_batch(stringhash9a_t *, uint8_t *, uint32_t *, int, uint8_t *);
+int stringhash9a_bulk_load(stringhash9a_t *, uint8_t *, uint32_t *, int);
+int stringhash9a_set_get_age(stringhash9a_t *, void *, int);
+int stringhash9a_check_get_age(stringhash9a_t *, void *, int);
+int stringhash9a_set_framed(stringhash9a_t *, uint8_t *, uint32_t, uint32_t,
+                            uint32_t *, uint32_t *, uint8_t *, int, uint32_t *);
 void stringhash9a_flush(stringhash9a_t *);
+int stringhash9a_enable_lazy_flush(stringhash9a_t *);
+int stringhash9a_flush_step(stringhash9a_t *, uint32_t);
+int stringhash9a_enable_stash(stringhash9a_t *);
+int stringhash9a_enable_hll(stringhash9a_t *, uint32_t);
+int stringhash9a_enable_verify(stringhash9a_t *);
+int stringhash9a_enable_front(stringhash9a_t *, uint32_t);
+double stringhash9a_hll_estimate(stringhash9a_t *);
+int stringhash9a_hll_merge(stringhash9a_t *, stringhash9a_t *);
+int stringhash9a_trace_open(stringhash9a_t *, const char *);
+void stringhash9a_trace_close(stringhash9a_t *);
+
+stringhash9a_window_t * stringhash9a_window_create(size_t);
+int stringhash9a_window_check(stringhash9a_window_t *, void *, int);
+int stringhash9a_window_set(stringhash9a_window_t *, void *, int);
+void stringhash9a_window_rotate(stringhash9a_window_t *);
+void stringhash9a_window_destroy(stringhash9a_window_t *);
+
+stringhash9a_group_t * stringhash9a_group_create(void);
+int stringhash9a_group_add(stringhash9a_group_t *, size_t);
+uint64_t stringhash9a_group_check(stringhash9a_group_t *, void *, int, uint64_t);
+uint64_t stringhash9a_group_set(stringhash9a_group_t *, void *, int, uint64_t);
+void stringhash9a_group_destroy(stringhash9a_group_t *);
 void stringhash9a_destroy(stringhash9a_t *);
 
 #endif // _STRINGHASH9A_H
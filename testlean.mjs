@@ -0,0 +1,59 @@
+//smoke test for the lean standalone module: loads sh9lean.wasm through
+// sh9.mjs, sets and checks keys, and grows wasm memory with a large table so
+// the growth import and the heap view refresh are exercised.  exits non-zero
+// on failure, or if sh9lean.wasm is missing or out of date (see README)
+//   node testlean.mjs [path/to/sh9lean.wasm]
+import { statSync } from 'fs';
+import { loadStringhash9a } from './sh9.mjs';
+
+const REBUILD = "rebuild required - build sh9lean.wasm with the emcc command under" +
+                " Lean standalone module in README.md";
+
+const source = process.argv[2] || new URL('./sh9lean.wasm', import.meta.url);
+try {
+ statSync(source);
+} catch (e) {
+ console.error("testlean: sh9lean.wasm not found, " + REBUILD);
+ process.exit(1);
+}
+
+let failures = 0;
+function check(cond, what) {
+ if (!cond) {
+   console.error("  FAIL " + what);
+   failures++;
+ }
+}
+
+let sh9;
+try {
+ sh9 = await loadStringhash9a(source);
+} catch (e) {
+ console.error("testlean: " + e.message);
+ process.exit(1);
+}
+const sh = sh9.create(100000);
+check(sh.set("mystring") === 0, "first set is new");
+check(sh.set("mystring") === 1, "second set is seen");
+check(sh.check("mystring") === 1, "check finds a set key");
+check(sh.check("otherstring") === 0, "check misses an unset key");
+check(sh.delete("mystring") === 1 && sh.check("mystring") === 0, "delete removes a key");
+
+//keys past the 63 byte cap are cut to the same bytes whether they come in
+// as a string or already encoded
+const long = "k".repeat(100);
+sh.set(long);
+check(sh.check(new TextEncoder().encode(long)) === 1, "long key as string and bytes");
+
+//a table this size grows memory well past its initial size
+const bytesBefore = sh9.exports.memory.buffer.byteLength;
+const big = sh9.create(20000000);
+check(sh9.exports.memory.buffer.byteLength > bytesBefore, "memory grew");
+check(big.set("after growth") === 0 && big.check("after growth") === 1,
+      "set/check after growth");
+check(sh.check(long) === 1, "old table intact after growth");
+big.destroy();
+sh.destroy();
+
+console.log("testlean " + (failures ? "FAILED" : "ok"));
+process.exit(failures ? 1 : 0);